@@ -0,0 +1,266 @@
+/*
+ * action.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Action executor- runs clip and level scripts on its own thread so a slow script
+ * never holds up metering, VU output or GPIOs in the main loop.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wordexp.h>
+#include <sys/wait.h>
+
+#include "action.h"
+#include "utils.h"
+
+extern char ** environ;
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	bool started;
+	struct action * q[ACTION_QUEUE]; /* queued, in post order */
+	unsigned n;
+	struct action * running[ACTION_QUEUE];
+	unsigned nrun;
+	struct action_stats stats;
+} ex = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static uint64_t ns_between(const struct timespec * a, const struct timespec * b){
+	return (b->tv_sec - a->tv_sec) * 1000000000LL + (b->tv_nsec - a->tv_nsec);
+}
+
+void action_init(struct action * a, const char * cmd, const char * var, unsigned timeout_ms){
+	memset(a, 0, sizeof(*a));
+	a->cmd = cmd;
+	a->var = var;
+	a->timeout_ms = timeout_ms;
+	a->_last = -1;
+}
+
+/* queue a run of the command with var=val, or without var if val < 0. Never blocks on the command */
+void action_post(struct action * a, int val){
+	action_post_at(a, val, NULL);
+}
+
+/* action_post() with the time the cause happened, for the start latency histogram. NULL for now */
+void action_post_at(struct action * a, int val, const struct timespec * origin){
+	if(!a->cmd)
+		return;
+	pthread_mutex_lock(&ex.lock);
+	ex.stats.posted++;
+	if(a->_queued){ /* not started yet- just update it, and keep timing from the first */
+		a->_val = val;
+		ex.stats.coalesced++;
+	} else if(ex.n == ACTION_QUEUE)
+		ex.stats.dropped++;
+	else {
+		a->_val = val;
+		a->_queued = true;
+		clock_gettime(CLOCK_MONOTONIC, &a->_posted);
+		a->_origin = origin ? *origin : a->_posted;
+		ex.q[ex.n++] = a;
+		if(ex.n > ex.stats.max_depth)
+			ex.stats.max_depth = ex.n;
+	}
+	pthread_cond_signal(&ex.cond);
+	pthread_mutex_unlock(&ex.lock);
+}
+
+/* usual argument parsing of cmd, with ${var} in the arguments replaced by val, and var=val in the environment.
+ * return child pid or -1 */
+static pid_t action_spawn(const struct action * a, int val){
+	wordexp_t p;
+	if(wordexp(a->cmd, &p, 0))
+		return -1;
+
+	char ** argv = calloc(p.we_wordc + 1, sizeof(char *));
+	size_t nenv = 0;
+	while(environ[nenv])
+		nenv++;
+	char ** envp = calloc(nenv + 2, sizeof(char *));
+	char * sval = NULL, * match = NULL, * set = NULL;
+	pid_t pid = -1;
+	if(!argv || !envp)
+		goto out;
+	memcpy(argv, p.we_wordv, sizeof(char *) * p.we_wordc);
+	memcpy(envp + 1, environ, sizeof(char *) * nenv);
+
+	if(a->var && val >= 0){
+		if(asprintf(&sval, "%d", val) < 0 || asprintf(&match, "${%s}", a->var) < 0 ||
+				asprintf(&set, "%s=%s", a->var, sval) < 0)
+			goto out;
+		envp[0] = set; /* first, so it wins over an inherited one */
+
+		/* check if argv contains ${ENV}, and replace */
+		for(size_t i = 1; i < p.we_wordc; i++){
+			char * m = strstr(argv[i], match);
+			if(!m)
+				continue;
+			char * n;
+			if(asprintf(&n, "%.*s%s%s", (int)(m - argv[i]), argv[i], sval, m + strlen(match)) < 0)
+				goto out;
+			argv[i] = n; /* freed below */
+		}
+	}
+
+	if((errno = posix_spawnp(&pid, argv[0], NULL, NULL, argv, set ? envp : envp + 1))){
+		fprintf(stderr, "Can't run \"%s\": %s\n", a->cmd, strerror(errno));
+		pid = -1;
+	}
+out:
+	for(size_t i = 1; argv && i < p.we_wordc; i++)
+		if(argv[i] != p.we_wordv[i])
+			free(argv[i]);
+	free(sval);
+	free(match);
+	free(set);
+	free(argv);
+	free(envp);
+	wordfree(&p);
+	return pid;
+}
+
+/* collect exited children and kill ones over time. Called with the lock held */
+static void action_reap(void){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for(unsigned i = 0; i < ex.nrun;){
+		struct action * a = ex.running[i];
+		int status;
+		pid_t r = waitpid(a->_pid, &status, WNOHANG);
+		if(!r){
+			if(timespec_isset(&a->_deadline) && timespec_compare(&now, &a->_deadline) >= 0){
+				kill(a->_pid, SIGKILL);
+				clear_timer(&a->_deadline); /* reaped next time round */
+				ex.stats.timeouts++;
+				if(a->debug)
+					fprintf(stderr, "(%s) \"%s\" killed after %ums\n", a->name, a->cmd, a->timeout_ms);
+			}
+			i++;
+			continue;
+		}
+
+		uint64_t ns = ns_between(&a->_started, &now);
+		ex.stats.reaped++;
+		ex.stats.run_ns += ns;
+		if(ns > ex.stats.run_max_ns)
+			ex.stats.run_max_ns = ns;
+		if(r < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+			ex.stats.failed++;
+		if(a->debug && r > 0 && WIFEXITED(status))
+			fprintf(stderr, "(%s) \"%s\" exit %d in %0.1fms\n", a->name, a->cmd, WEXITSTATUS(status), ns / 1e6);
+		a->_pid = 0;
+		ex.running[i] = ex.running[--ex.nrun];
+	}
+}
+
+static void * action_thread(void * arg){
+	(void)arg;
+	pthread_mutex_lock(&ex.lock);
+	while(true){
+		action_reap();
+
+		/* start queued actions that aren't still running a previous request- in post order */
+		for(unsigned i = 0; i < ex.n && ex.nrun < ACTION_QUEUE;){
+			struct action * a = ex.q[i];
+			if(a->_pid){
+				i++;
+				continue;
+			}
+			ex.n--;
+			memmove(&ex.q[i], &ex.q[i + 1], (ex.n - i) * sizeof(*ex.q));
+			a->_queued = false;
+			int val = a->_val;
+			if(a->dedupe && val >= 0 && val == a->_last){ /* already in that state */
+				ex.stats.dropped++;
+				continue;
+			}
+
+			/* spawn without the lock so posting never waits on it- only this thread takes from the queue */
+			pthread_mutex_unlock(&ex.lock);
+			if(a->debug && val >= 0)
+				fprintf(stderr, "(%s) Running \"%s\" with env %s=%d\n", a->name, a->cmd, a->var, val);
+			else if(a->debug)
+				fprintf(stderr, "(%s) Running \"%s\"\n", a->name, a->cmd);
+			pid_t pid = action_spawn(a, val);
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			pthread_mutex_lock(&ex.lock);
+
+			uint64_t ns = ns_between(&a->_posted, &now);
+			ex.stats.queue_ns += ns;
+			if(ns > ex.stats.queue_max_ns)
+				ex.stats.queue_max_ns = ns;
+			ex.stats.run++;
+			if(pid < 0){ /* not in that state- a repeat tries again */
+				ex.stats.failed++;
+				continue;
+			}
+			a->_last = val;
+			hist_add(&a->lat, ns_between(&a->_origin, &now));
+			a->_pid = pid;
+			a->_started = now;
+			set_timer(&a->_deadline, a->timeout_ms);
+			ex.running[ex.nrun++] = a;
+		}
+
+		if(ex.nrun){ /* poll children */
+			struct timespec t;
+			set_timer(&t, 10);
+			pthread_cond_timedwait(&ex.cond, &ex.lock, &t);
+		} else
+			pthread_cond_wait(&ex.cond, &ex.lock);
+	}
+	return NULL;
+}
+
+/* start the executor thread */
+int action_start(void){
+	if(ex.started)
+		return 0;
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&ex.cond, &attr);
+	pthread_condattr_destroy(&attr);
+	if((errno = pthread_create(&ex.thread, NULL, action_thread, NULL))){
+		perror("action thread");
+		return 1;
+	}
+	ex.started = true;
+	return 0;
+}
+
+void action_get_stats(struct action_stats * s){
+	pthread_mutex_lock(&ex.lock);
+	*s = ex.stats;
+	s->depth = ex.n;
+	pthread_mutex_unlock(&ex.lock);
+}
+
+void action_get_lat(struct action * a, struct hist * h){
+	pthread_mutex_lock(&ex.lock);
+	*h = a->lat;
+	pthread_mutex_unlock(&ex.lock);
+}
+
+void action_print_stats(FILE * fp){
+	struct action_stats s;
+	action_get_stats(&s);
+	fprintf(fp, "actions: depth %u (max %u), posted %lu, coalesced %lu, dropped %lu, run %lu, failed %lu, timeouts %lu, "
+			"queued avg %0.2fms max %0.2fms, ran avg %0.1fms max %0.1fms\n",
+			s.depth, s.max_depth, s.posted, s.coalesced, s.dropped, s.run, s.failed, s.timeouts,
+			s.run ? s.queue_ns / 1e6 / s.run : 0.0, s.queue_max_ns / 1e6,
+			s.reaped ? s.run_ns / 1e6 / s.reaped : 0.0, s.run_max_ns / 1e6);
+}
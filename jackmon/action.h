@@ -0,0 +1,67 @@
+/*
+ * action.h
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#ifndef ACTION_H_
+#define ACTION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "utils.h"
+
+/* max requests waiting to run- one per action is enough since they coalesce */
+#define ACTION_QUEUE 16
+
+/* a script the main loop fires on a state change, eg clip_cmd with CLIP=1/0.
+ * Commands run on the executor thread, one at a time per action and in order.
+ * A request posted while the last one is still queued replaces it. With dedupe, a state the command was
+ * already last run with is dropped- so bursts of CLIP=1/CLIP=0 collapse to what it needs to end up at */
+struct action {
+	const char * cmd;
+	const char * var; /* environment variable set to the posted value, and ${var} in cmd args */
+	unsigned timeout_ms; /* killed after this */
+	const char * name; /* for debug */
+	bool debug;
+	bool dedupe; /* the main loop posts both states- drop a repeat of the last. Not for one shots that never post 0 */
+	/* executor state- under the queue lock */
+	int _val; /* value of the queued request, -1 for a one shot without var */
+	int _last; /* value last run with, -1 if none */
+	bool _queued;
+	struct timespec _posted;
+	struct timespec _origin; /* what the request is timed from- eg signal onset, else when posted */
+	struct hist lat; /* origin to spawn */
+	pid_t _pid; /* running child */
+	struct timespec _started;
+	struct timespec _deadline;
+};
+
+/* counters for the executor */
+struct action_stats {
+	unsigned depth; /* queued now */
+	unsigned max_depth;
+	unsigned long posted;
+	unsigned long coalesced; /* replaced a queued request */
+	unsigned long dropped; /* queue full, or already in that state */
+	unsigned long run;
+	unsigned long reaped; /* exited or killed */
+	unsigned long failed; /* failed to spawn, or non-zero exit */
+	unsigned long timeouts; /* killed */
+	uint64_t queue_ns, queue_max_ns; /* post to spawn, total and max */
+	uint64_t run_ns, run_max_ns; /* spawn to exit */
+};
+
+void action_init(struct action * a, const char * cmd, const char * var, unsigned timeout_ms);
+int action_start(void);
+void action_post(struct action * a, int val);
+void action_post_at(struct action * a, int val, const struct timespec * origin);
+void action_get_lat(struct action * a, struct hist * h);
+void action_get_stats(struct action_stats * s);
+void action_print_stats(FILE * fp);
+
+#endif /* ACTION_H_ */
@@ -10,250 +10,798 @@
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
+#include <poll.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <jack/thread.h>
 
 #include "utils.h"
 #include "audio.h"
+#include "host.h"
+
+static bool jack_find_source_ports(struct audio * audio);
+
+/* publish channel state from the realtime thread- never blocks */
+static void audio_chan_publish(const struct meter * meter, struct meter_state * m, struct chan_snap * s){
+	seq_write_begin(&s->seq);
+	s->rms = rms_get(&m->rms);
+	peak_get(&m->peak, &s->peak); /* ignore updates since these will be accumulated in the event count */
+	s->clips += clip_get(&m->clip);
+	s->events += m->pending;
+	if(meter->win.en)
+		s->win = win_get(&meter->win, &m->win);
+	seq_write_end(&s->seq);
+	m->pending = 0;
+}
+
+/* the values of a snapshot, without its seq */
+static void audio_snap_copy(struct chan_snap * to, const struct chan_snap * from){
+	to->rms = from->rms;
+	to->peak = from->peak;
+	to->clips = from->clips;
+	to->events = from->events;
+	to->win = from->win;
+}
 
-struct audio gAudio;
-
-static int jack_process_frame (jack_nframes_t nframes, void *arg);
-static void jack_connect_cb(jack_port_id_t a, jack_port_id_t b, int connect, void *arg);
-static void jack_shutdown (void *arg);
-
-/* Compute 2nd order Butterworth low-pass biquad coefficients
- * fc = cutoff frequency (Hz)
- * fs = sample rate (Hz)
-*/
-void init_lowpass_biquad(double fc, double fs, struct biquad * b)
-{
-    double omega = 2.0 * M_PI * fc / fs; /* Pre-warp cutoff frequency to normalized rad/s */
-    double cos_omega = cos(omega);
-    double alpha = sin(omega) / (2.0 * M_SQRT1_2); /* Butterworth (Q = 1/sqrt(2)) */
-    double s = 1.0 / (1.0 + alpha); /* normalise for a0 = 1 */
-    b->b1 = (ftype)(s * (1.0 - cos_omega));
-    b->b0 = b->b2 = (ftype)(b->b1 * 0.5);
-    b->a1 = (ftype)(s * -2.0 * cos_omega);
-    b->a2 = (ftype)(s * (1.0 - alpha));
-    b->z1 = b->z2 = b->y = 0.0;
-}
-
-/* can be reinitialised */
-void rms_init(struct rms * rms, double samplerate){
-	rms->en = true;
-	double fc = 6.0; /* -3dB at 6Hz emulates mechanical meter smoothing */
-	init_lowpass_biquad(fc, samplerate, &rms->f);
-}
-
-void peak_init(struct peak * peak, ftype atten, unsigned decay_samples, unsigned hold_ms){
-	peak->peak = peak->_peak = 0.0;
-	peak->_hold.tv_sec = 0;
-	peak->_hold.tv_nsec = 0;
-	peak->hold_time = hold_ms;
-	peak->decay_samples = decay_samples;
-	peak->_decay = fpow(atten, 1.0/(ftype)decay_samples);
-	peak->event = false;
-}
-
-void clip_init(struct clip * clip, unsigned threshold) {
-	clip->event = false;
-	clip->n = 0;
-	clip->threshold = threshold;
-}
-
-/* run this in background loop, in critical section */
-int audio_chan_poll(struct chan * s){
-	int events = s->pending;
-	s->pending = 0;
-	s->rms_val = rms_get(&s->rms);
-	peak_get(&s->peak, &s->peak_val); /* ignore updates since these will be accumulated in the event count */
-	s->clip_event |= clip_get(&s->clip);
+/* run this in background loop- copy the last published snapshot */
+static int audio_chan_poll(struct chan * c, struct chan_snap * s){
+	unsigned seq, clips, events;
+	ftype win;
+	do {
+		seq = seq_read_begin(&s->seq);
+		c->rms_val = s->rms;
+		c->peak_val = s->peak;
+		clips = s->clips;
+		events = s->events;
+		win = s->win;
+	} while(seq_read_retry(&s->seq, seq));
+
+	c->clip_event |= clips != c->_clips;
+	c->_clips = clips;
+	c->win_val = win > 0.0 ? sqrtff(win) : 0.0;
+	events -= c->_events;
+	c->_events += events;
 	return events;
 }
 
-/* poll at given rate, if theres something to do return > 1, 0 for no events (eg clip/peak), or -1 and errno set */
-int audio_poll(struct audio * audio, unsigned period_ms){
+/* realtime thread- queue an event for channel chan of bank b, never blocks */
+static void audio_event_put(struct audio_events * q, const struct audio_bank * b, uint64_t frame, int offset, unsigned chan,
+		enum audio_event_type type){
+	unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	if(head - atomic_load_explicit(&q->tail, memory_order_acquire) >= AUDIO_EVENTS){
+		atomic_fetch_add_explicit(&q->dropped, 1, memory_order_relaxed);
+		return;
+	}
+	struct audio_event * ev = &q->ev[head % AUDIO_EVENTS];
+	ev->frame = frame;
+	ev->offset = offset;
+	ev->chan = chan;
+	ev->type = type;
+	ev->bank = b->gen;
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+/* main loop- take the oldest event, with chan an index in the bank now. Events from the bank before are moved to
+ * where their channel is now, and dropped if it went. return false if there are none */
+bool audio_event_get(struct audio * audio, struct audio_event * ev){
+	struct audio_events * q = audio->events;
+	const struct audio_bank * b = atomic_load_explicit(&audio->bank, memory_order_relaxed); /* only the main loop swaps it */
+	unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	while(tail != atomic_load_explicit(&q->head, memory_order_acquire)){
+		*ev = q->ev[tail % AUDIO_EVENTS];
+		atomic_store_explicit(&q->tail, ++tail, memory_order_release);
+		if(ev->bank == (uint8_t)b->gen)
+			return true;
+		if(ev->bank == (uint8_t)(b->gen - 1) && ev->chan < b->prev_channels && b->next[ev->chan] >= 0){
+			ev->chan = b->next[ev->chan];
+			ev->bank = b->gen;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* wake up the main loop. Safe to call from the realtime thread- its a single non-blocking write */
+void audio_wake(struct audio * audio){
+	if(!atomic_exchange_explicit(&audio->wake_pending, true, memory_order_acq_rel))
+		eventfd_write(audio->h_wake, 1);
+}
+
+static void audio_bank_free(struct audio_bank * b){
+	if(!b)
+		return;
+	if(b->sources)
+		for(unsigned i = 0; i < b->channels; i++)
+			free(b->sources[i]);
+	free(b->sources);
+	free(b->port);
+	free(b->jports);
+	free(b->outs);
+	free(b->state);
+	free(b->snap);
+	free(b->bufs);
+	free(b->wbufs);
+	free(b->prev);
+	free(b->next);
+	free(b);
+}
+
+/* a bank of channels, after one of prev_channels. They're all new to it until audio_bank_build() finds them */
+static struct audio_bank * audio_bank_alloc(unsigned channels, unsigned prev_channels){
+	struct audio_bank * b = calloc(1, sizeof(struct audio_bank));
+	if(!b)
+		return NULL;
+	b->channels = channels;
+	b->prev_channels = prev_channels;
+	if(!((b->state = aligned_calloc(channels, sizeof(struct meter_state)))) ||
+			!((b->snap = aligned_calloc(channels, sizeof(struct chan_snap)))) ||
+			!((b->port = calloc(channels ?: 1, sizeof(unsigned)))) ||
+			!((b->jports = calloc(channels ?: 1, sizeof(jack_port_t *)))) ||
+			!((b->outs = calloc(channels ?: 1, sizeof(jack_port_t *)))) ||
+			!((b->bufs = calloc(channels ?: 1, sizeof(float *)))) ||
+			!((b->wbufs = calloc(channels ?: 1, sizeof(float *)))) ||
+			!((b->prev = malloc((channels ?: 1) * sizeof(int)))) ||
+			!((b->next = malloc((prev_channels ?: 1) * sizeof(int)))) ||
+			!((b->sources = calloc(channels ?: 1, sizeof(char *))))){
+		audio_bank_free(b);
+		return NULL;
+	}
+	for(unsigned i = 0; i < channels; i++)
+		b->prev[i] = -1;
+	for(unsigned i = 0; i < prev_channels; i++)
+		b->next[i] = -1;
+	return b;
+}
+
+/* index of the channel connected to source in bank b, or -1 */
+static int audio_bank_find(const struct audio_bank * b, const char * source){
+	for(unsigned i = 0; b && i < b->channels; i++)
+		if(b->sources[i] && !strcmp(b->sources[i], source))
+			return i;
+	return -1;
+}
+
+/* true if port number num is taken in bank b- its first n channels */
+static bool audio_port_used(const struct audio_bank * b, unsigned n, unsigned num){
+	for(unsigned i = 0; b && i < n; i++)
+		if(b->port[i] == num)
+			return true;
+	return false;
+}
+
+/* register our input port number num, or its level_gate output. Ports are named by number, with the context name in
+ * front if the client is shared, and outputs have out_ in front of the number */
+static jack_port_t * audio_port_register(struct audio * audio, unsigned num, bool out){
+	char * in;
+	const char * dir = out ? "out_" : "";
+	if((audio->host->n > 1 ? asprintf(&in, "%s_%s%u", audio->name, dir, num) : asprintf(&in, "%s%u", dir, num)) < 0)
+		return NULL;
+	jack_port_t * p = jack_port_register(audio->jclient, in, JACK_DEFAULT_AUDIO_TYPE, out ? JackPortIsOutput : JackPortIsInput, 0);
+	if(!p)
+		debug(audio, "Failed to register port %s\n", in);
+	free(in);
+	return p;
+}
+
+/* unregister the ports of bank b that aren't in bank keep */
+static void audio_ports_unregister(struct audio * audio, const struct audio_bank * b, const struct audio_bank * keep){
+	for(unsigned i = 0; i < b->channels; i++){
+		bool kept = false;
+		for(unsigned j = 0; keep && j < keep->channels && !kept; j++)
+			kept = keep->jports[j] == b->jports[i];
+		if(b->jports[i] && !kept)
+			jack_port_unregister(audio->jclient, b->jports[i]);
+		if(b->outs[i] && !kept)
+			jack_port_unregister(audio->jclient, b->outs[i]);
+	}
+}
+
+/* the thread running the meters, on the first cycle of bank b- carry over the meter state of channels whose source
+ * was in the bank before. It was the only one writing it, so the copy is whole, and the main loop doesn't free the
+ * old bank until this thread has moved on from it */
+static void audio_bank_carry(struct audio_bank * b){
+	for(unsigned i = 0; i < b->channels; i++){
+		if(b->prev[i] < 0)
+			continue;
+		b->state[i] = b->from->state[b->prev[i]];
+		seq_write_begin(&b->snap[i].seq);
+		audio_snap_copy(&b->snap[i], &b->from->snap[b->prev[i]]);
+		seq_write_end(&b->snap[i].seq);
+	}
+	b->from = NULL;
+}
+
+/* main loop- build a bank for the ports in source_ports. A channel whose source was in old keeps its port, and
+ * carries on with its meter state- see audio_bank_carry(). Its snapshot is copied now too, so the main loop sees the
+ * old values until then. New channels get the lowest port numbers free in both banks, as the ports of channels
+ * that went are only unregistered once the old bank is retired. Return NULL on failure */
+static struct audio_bank * audio_bank_build(struct audio * audio, const struct audio_bank * old){
+	unsigned n = 0;
+	while(audio->source_ports && audio->source_ports[n])
+		n++;
+	struct audio_bank * b = audio_bank_alloc(n, old ? old->channels : 0);
+	if(!b)
+		return NULL;
+	b->gen = old ? old->gen + 1 : 0;
+	for(unsigned i = 0; i < n; i++){
+		int j = audio_bank_find(old, audio->source_ports[i]);
+		if(!((b->sources[i] = strdup(audio->source_ports[i]))))
+			goto fail;
+		if(j < 0 || b->next[j] >= 0) /* new, or listed twice */
+			continue;
+		b->prev[i] = j;
+		b->next[j] = i;
+		b->port[i] = old->port[j];
+		b->jports[i] = old->jports[j];
+		b->outs[i] = old->outs[j];
+		unsigned seq;
+		do {
+			seq = seq_read_begin(&old->snap[j].seq);
+			audio_snap_copy(&b->snap[i], &old->snap[j]);
+		} while(seq_read_retry(&old->snap[j].seq, seq));
+		b->from = (struct audio_bank *)old;
+	}
+	for(unsigned i = 0, num = 1; i < n; i++){
+		if(b->port[i])
+			continue;
+		while(audio_port_used(old, old ? old->channels : 0, num) || audio_port_used(b, n, num))
+			num++;
+		b->port[i] = num;
+		if(!((b->jports[i] = audio_port_register(audio, num, false))) ||
+				(audio->level_gate && !((b->outs[i] = audio_port_register(audio, num, true)))))
+			goto fail;
+	}
+	return b;
+fail:
+	audio_ports_unregister(audio, b, old);
+	audio_bank_free(b);
+	return NULL;
+}
+
+/* main loop- main loop copies for a new bank, carried over for the channels that were in the old one */
+static int audio_chan_resize(struct audio * audio, const struct audio_bank * b){
+	struct chan * chan = calloc(b->channels ?: 1, sizeof(struct chan));
+	if(!chan)
+		return 1;
+	for(unsigned i = 0; i < b->channels; i++)
+		if(b->prev[i] >= 0)
+			chan[i] = audio->chan[b->prev[i]];
+	free(audio->chan);
+	audio->chan = chan;
+	audio->channels = b->channels;
+	return 0;
+}
+
+/* main loop- free the swapped out bank once the realtime thread has started a cycle on the new one, so nothing is
+ * freed under it. With offload the worker has to have finished one of those cycles too- it runs them in order.
+ * Then the ports of channels that went are unregistered, which disconnects their sources, and the meter ring laid
+ * out again */
+static void audio_bank_retire(struct audio * audio){
+	struct audio_bank * old = audio->_retired, * b = atomic_load_explicit(&audio->bank, memory_order_relaxed);
+	if(!old)
+		return;
+	if(audio->host->jack_activated && (atomic_load_explicit(&audio->_bank_rt, memory_order_acquire) != b ||
+			(audio->worker && atomic_load_explicit(&audio->worker->bank, memory_order_acquire) != b)))
+		return;
+	audio_ports_unregister(audio, old, b);
+	audio_bank_free(old);
+	audio->_retired = NULL;
+	debug(audio, "Retired the old channel bank\n");
+	if(audio->_shm_reopen){
+		audio->_shm_reopen = false;
+		vushm_open(audio);
+	}
+}
+
+/* main loop- swap in a bank for the ports in source_ports, if they changed. The realtime thread picks it up at its
+ * next cycle, and audio_bank_retire() frees the old one once it has. Return 1 to try again later */
+static int audio_bank_swap(struct audio * audio){
+	struct audio_bank * old = atomic_load_explicit(&audio->bank, memory_order_relaxed), * b;
+	unsigned n = 0;
+	if(audio->_retired) /* still on the last one */
+		return 1;
+	while(audio->source_ports[n] && n < old->channels && old->sources[n] && !strcmp(audio->source_ports[n], old->sources[n]))
+		n++;
+	if(n == old->channels && !audio->source_ports[n])
+		return 0; /* same ports- just reconnect them */
+
+	if(!((b = audio_bank_build(audio, old))))
+		return 1;
+	if(audio_chan_resize(audio, b)){
+		audio_ports_unregister(audio, b, old);
+		audio_bank_free(b);
+		return 1;
+	}
+	if(atomic_load_explicit(&audio->shm, memory_order_relaxed)){ /* the ring is laid out for the old channels */
+		atomic_store_explicit(&audio->shm, NULL, memory_order_relaxed);
+		audio->_shm_reopen = true;
+	}
+	if(!audio->host->jack_activated && b->from) /* nothing running the meters- and the old one goes now */
+		audio_bank_carry(b);
+	atomic_store_explicit(&audio->bank, b, memory_order_release);
+	audio->_retired = old;
+	audio->ports_changed++;
+	debug(audio, "Channels %u -> %u\n", old->channels, b->channels);
+	audio_bank_retire(audio);
+	return 0;
+}
+
+/* collect the latest snapshots after a wake up or timeout. return number of events (eg clip/peak) since last call */
+int audio_poll(struct audio * audio){
 	int events = 0;
 
-	/* wait for CV or timeout */
-	struct timespec t;
-	set_timer(&t, period_ms);
-	pthread_mutex_lock(&audio->mutex);
-	int err = 0;
-	while(!audio->event && !err)
-		err = pthread_cond_timedwait(&audio->cond, &audio->mutex, &t);
-	if(err && err != ETIMEDOUT){
-		errno = err;
-		events = -1;
-		goto done;
-	}
-	audio->event = 0;
-
-	if(!audio->disconnected)
-		for (int i = 0; i < audio->channels; i++)
-			events += audio_chan_poll(&audio->chan[i]);
-	else
+	eventfd_t v;
+	eventfd_read(audio->h_wake, &v); /* non-blocking- just clears it */
+	atomic_store_explicit(&audio->wake_pending, false, memory_order_release);
+
+	if(!audio->offline)
+		audio_bank_retire(audio);
+	struct audio_bank * b = atomic_load_explicit(&audio->bank, memory_order_relaxed); /* only the main loop swaps it */
+	for (unsigned i = 0; i < audio->channels; i++)
+		events += audio_chan_poll(&audio->chan[i], &b->snap[i]);
+	if(audio->disconnected)
 		events++;
-done:
-	pthread_mutex_unlock(&audio->mutex);
 	return events;
 }
 
-int audio_init(struct audio * audio) {
-	/* init threading */
-	pthread_mutex_init(&audio->mutex, NULL);
-	pthread_condattr_t condAttr;
-	pthread_condattr_init(&condAttr);
-	pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
-	pthread_cond_init(&audio->cond, &condAttr);
-
-	/* open a client connection to the JACK server */
-	jack_status_t status;
-	if(!((audio->jclient = jack_client_open(audio->name, JackNoStartServer, &status, audio->server)))) {
-		debug("jack_client_open() failed, status = 0x%2.0x\n", status);
-		if (status & JackServerFailed)
-			fprintf (stderr, "Unable to connect to JACK server\n");
+/* set up the meters, events and wake up once samplerate is known */
+static int audio_meter_init(struct audio * audio){
+	dsp_init();
+	debug(audio, "DSP using %s\n", dsp_isa);
+
+	/* main loop wake up from realtime and jack notification threads */
+	if((audio->h_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0){
+		perror("eventfd");
 		return 1;
 	}
 
-	if(status & JackNameNotUnique)
-		audio->name = jack_get_client_name(audio->jclient);
+	if(!((audio->events = aligned_calloc(1, sizeof(struct audio_events)))))
+		return 1;
 
-	audio->samplerate = jack_get_sample_rate(audio->jclient);
+	if(audio->vu_peak_hold_ms)
+		peak_init(&audio->meter.peak, fpow(10.0, -65.0/20.0),
+				ms_to_frames(audio->vu_peak_hold_ms, audio->samplerate),
+				ms_to_frames(audio->vu_peak_hold_ms, audio->samplerate)); /* decay next peak to -65dB in vu_peak_hold_ms */
+	audio->meter.true_peak = audio->true_peak;
+	if(audio->clip_en)
+		clip_init(&audio->meter.clip, audio->clip_samples);
+	if(audio->rms_en){
+		rms_init(&audio->meter.rms, (double)audio->samplerate, 0);
+		if(audio->level_sec && !audio->level_window_ms){ /* onset and release events */
+			audio->meter.rms.thres_sq = audio->level_thres * audio->level_thres;
+			audio->meter.rms.rel_sq = audio->level_release * audio->level_release;
+		}
+	}
+	if(audio->level_gate)
+		gate_init(&audio->gate, ms_to_frames(audio->level_gate_ms, audio->samplerate),
+				ms_to_frames(audio->level_sec*1000ULL, audio->samplerate));
+	if(audio->level_sec && audio->level_window_ms)
+		win_init(&audio->meter.win, ms_to_frames(audio->level_window_ms, audio->samplerate), audio->level_windows,
+				audio->level_thres * audio->level_thres, audio->level_release * audio->level_release);
+	if(audio->loudness){
+		loud_init(&audio->meter.loud, audio->samplerate);
+		if(!((audio->loud = loudness_init())))
+			return 1;
+	}
+	if(audio->bands && !((audio->spectrum = bands_init(audio->bands, audio->samplerate,
+			ms_to_frames(audio->vu_ms, audio->samplerate))))) /* a level per vu update */
+		return 1;
+	return 0;
+}
 
-    /* get the list of source ports that match and are active */
-	jack_wait_for_source_ports(audio);
+/* the first bank, and the meter ring sized for it */
+static int audio_bank_start(struct audio * audio, struct audio_bank * b){
+	if(!b || audio_chan_resize(audio, b))
+		return 1;
+	atomic_store_explicit(&audio->bank, b, memory_order_release);
+	if(audio->vu_shm && vushm_open(audio))
+		return 1;
+	return 0;
+}
 
-	/* count channels */
-    for (int i = 0; audio->source_ports[i]; i++)
-    	audio->channels++;
+/* set up the channel bank without a jack client- samples are fed with audio_process() */
+int audio_init_offline(struct audio * audio, ftype samplerate, unsigned channels){
+	audio->offline = true;
+	audio->samplerate = samplerate;
+	if(audio_meter_init(audio))
+		return 1;
+	if(audio->fanout && !((audio->pool = fanout_init(audio->fanout, audio->fanout_min, 0))))
+		return 1;
+	return audio_bank_start(audio, audio_bank_alloc(channels, 0));
+}
 
-    if(audio->level_sinks &&
-    		((audio->_level_sink_ports = jack_get_ports(audio->jclient, audio->level_sinks, NULL, JackPortIsInput)))) {
-    	for(int i = 0; audio->_level_sink_ports[i]; i++)
-    		debug("Route source %d -> sink %s when threshold is reached\n", i+1, audio->_level_sink_ports[i]);
-    }
+/* realtime thread- queue the 100ms loudness blocks the channels of bank completed, summed over channels. Blocks end
+ * on the same sample clock for every channel, so they complete together- only the last blocks every channel
+ * completed are queued, each channel indexed by its own count. A channel new in this bank drops its first partial
+ * block this way */
+static void audio_loud_put(struct audio * audio, const struct audio_bank * bank){
+	unsigned n = LOUD_DONE;
+	if(!bank->channels)
+		return;
+	for(unsigned i = 0; i < bank->channels; i++)
+		if(bank->state[i].loud.n < n)
+			n = bank->state[i].loud.n;
+	for(unsigned b = 0; b < n; b++){
+		ftype sum = 0.0;
+		for(unsigned i = 0; i < bank->channels; i++)
+			sum += bank->state[i].loud.done[bank->state[i].loud.n - n + b];
+		loudness_put(audio->loud, sum / audio->meter.loud.block);
+	}
+}
 
-    /* allocate structs */
-	if(!((audio->chan = calloc(audio->channels, sizeof(struct chan)))))
-		return 1;
+/* realtime thread- queue level edges. Both in one block go in the order that leaves the main loop in the
+ * detectors final state */
+static void audio_level_put(struct audio * audio, const struct audio_bank * b, const struct meter_state * s, uint64_t frame,
+		unsigned chan){
+	bool on = dsp_level_on(&audio->meter, s);
+	if(s->level_at >= 0 && !on)
+		audio_event_put(audio->events, b, frame, s->level_at, chan, AUDIO_EVENT_LEVEL);
+	if(s->release_at >= 0)
+		audio_event_put(audio->events, b, frame, s->release_at, chan, AUDIO_EVENT_RELEASE);
+	if(s->level_at >= 0 && on)
+		audio_event_put(audio->events, b, frame, s->level_at, chan, AUDIO_EVENT_LEVEL);
+}
 
-	/* register ports per channel */
-	for (int i = 0; i < audio->channels; i++) {
-		struct chan * c = &audio->chan[i];
-		if(audio->vu_peak_hold_ms)
-			peak_init(&c->peak, fpow(10.0, -65.0/20.0),
-					(int)audio->samplerate*audio->vu_peak_hold_ms/1000,
-					audio->vu_peak_hold_ms); /* decay next peak to -65dB in vu_peak_hold_ms */
-		if(audio->clip_en)
-			clip_init(&c->clip, audio->clip_samples);
-		if(audio->rms_en)
-			rms_init(&c->rms, (double)audio->samplerate);
-
-		char *in="";
-		if(!asprintf(&in, "%d", i+1) ||
-				!((c->jport = jack_port_register(audio->jclient, in, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0)))){
-			debug("Failed to register port %s", in);
-			return 1;
+/* a block for the meters, for audio_bank_meters() */
+struct audio_block {
+	struct audio * audio;
+	struct audio_bank * b;
+	uint64_t frame;
+	const float * const * bufs;
+	unsigned n;
+};
+
+/* realtime thread, or a fanout helper- run the meters of channels [from, to) of a block. Return events */
+static unsigned audio_bank_meters(void * arg, unsigned from, unsigned to){
+	const struct audio_block * k = arg;
+	unsigned events = 0;
+	for (unsigned i = from; i < to; i++)
+		events += dsp_run(&k->audio->meter, &k->b->state[i], k->bufs[i], k->n, k->frame);
+	return events;
+}
+
+/* realtime thread- run the meters of bank over a block of n samples per channel starting at sample clock frame,
+ * and publish. The meters fan out across the helpers if there are enough channels, the rest stays on this thread.
+ * Return events */
+static unsigned audio_bank_process(struct audio * audio, struct audio_bank * b, uint64_t frame, const float * const * bufs, unsigned n){
+	struct audio_block k = { .audio = audio, .b = b, .frame = frame, .bufs = bufs, .n = n };
+	unsigned events = fanout_run(audio->pool, audio_bank_meters, &k, b->channels);
+	for (unsigned i = 0; i < b->channels; i++){
+		struct meter_state * s = &b->state[i];
+		if(s->clip_at >= 0)
+			audio_event_put(audio->events, b, frame, s->clip_at, i, AUDIO_EVENT_CLIP);
+		if(s->peak_at >= 0)
+			audio_event_put(audio->events, b, frame, s->peak_at, i, AUDIO_EVENT_PEAK);
+		if(s->level_at >= 0 || s->release_at >= 0){
+			audio_level_put(audio, b, s, frame, i);
+			events++; /* wake now- the level actions time from the edges */
 		}
+		audio_chan_publish(&audio->meter, s, &b->snap[i]);
 	}
+	if(audio->loud)
+		audio_loud_put(audio, b);
+	if(audio->spectrum)
+		bands_put(audio->spectrum, bufs, b->channels, n);
+	seq_write_begin(&audio->clock.seq);
+	audio->clock.frame = frame + n;
+	seq_write_end(&audio->clock.seq);
+	struct vushm_hdr * shm = atomic_load_explicit(&audio->shm, memory_order_relaxed); /* after the bank- see audio_bank_swap() */
+	if(shm)
+		vushm_publish(shm, b, frame + n);
+	return events;
+}
 
-	/* start jack callbacks */
-	jack_set_process_callback (audio->jclient, jack_process_frame, (void *)audio);
-	jack_set_port_connect_callback(audio->jclient, jack_connect_cb, (void *)audio);
-	jack_on_shutdown (audio->jclient, jack_shutdown, 0);
-	if (jack_activate (audio->jclient)) {
-		perror("cannot activate client");
+/* run the meters over a block of n samples per channel starting at sample clock frame, and publish. Return events */
+unsigned audio_process(struct audio * audio, uint64_t frame, const float * const * bufs, unsigned n){
+	return audio_bank_process(audio, atomic_load_explicit(&audio->bank, memory_order_acquire), frame, bufs, n);
+}
+
+/* offload worker- one cycle the realtime thread queued, its channels one after the other from x. The worker carries
+ * over to a new bank on its first cycle with it, and reads the ring through the banks own wbufs */
+static void audio_offload_cycle(void * arg, struct audio_bank * b, uint64_t frame, const float * x, unsigned n){
+	struct audio * audio = arg;
+	if(b->from)
+		audio_bank_carry(b);
+	for(unsigned i = 0; i < b->channels; i++)
+		b->wbufs[i] = x + i * n;
+	if(audio_bank_process(audio, b, frame, b->wbufs, n))
+		audio_wake(audio);
+}
+
+static void * audio_offload_thread(void * arg){
+	struct audio * audio = arg;
+	struct offload * o = audio->worker;
+	while(!atomic_load_explicit(&o->stop, memory_order_acquire)){
+		if(sem_wait(&o->wake) && errno == EINTR)
+			continue;
+		/* posted once per cycle- the first wake takes them all, the rest find nothing */
+		offload_run(o, audio_offload_cycle, audio);
+	}
+	return NULL;
+}
+
+/* realtime priority of the thread running the meters- jacks process thread, or the offload worker one under it
+ * unless offload_priority says otherwise. 0 or less for normal scheduling */
+static int audio_meters_priority(struct audio * audio){
+	int prio = jack_client_real_time_priority(audio->jclient); /* -1 if jack isn't realtime */
+	if(audio->offload)
+		prio = audio->offload_priority ?: prio - 1;
+	return prio;
+}
+
+/* start the offload worker, pinned to offload_cpus */
+static int audio_offload_start(struct audio * audio){
+	if(!((audio->worker = offload_init(ms_to_frames(audio->offload_ms, audio->samplerate)))))
+		return 1;
+	int prio = audio_meters_priority(audio);
+	if((errno = jack_client_create_thread(audio->jclient, &audio->_worker, prio, prio > 0, audio_offload_thread, audio))){
+		perror("offload thread");
+		offload_free(audio->worker);
+		audio->worker = NULL;
 		return 1;
 	}
-	audio->jack_activated = true;
+	if(audio->offload_cpus){
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for(unsigned i = 0; i < 8 * sizeof(unsigned long); i++)
+			if(audio->offload_cpus & (1UL << i))
+				CPU_SET(i, &set);
+		if((errno = pthread_setaffinity_np(audio->_worker, sizeof(set), &set)))
+			perror("offload_cpu"); /* carry on unpinned */
+	}
+	debug(audio, "Offloading the meters to a worker thread at %s %d, up to %ums behind\n",
+			prio > 0 ? "realtime priority" : "normal scheduling", prio > 0 ? prio : 0, audio->offload_ms);
+	return 0;
+}
 
-	/* make the connections */
-	jack_connect_source_ports(audio);
-    return 0;
+/* stop the offload worker, fanout helpers and band analyser once the jack client is closed, so they aren't running on
+ * what the caller frees next */
+void audio_stop(struct audio * audio){
+	if(audio->worker){
+		atomic_store_explicit(&audio->worker->stop, true, memory_order_release);
+		sem_post(&audio->worker->wake);
+		pthread_join(audio->_worker, NULL);
+		offload_free(audio->worker);
+		audio->worker = NULL;
+	}
+	fanout_free(audio->pool);
+	audio->pool = NULL;
+	bands_stop(audio->spectrum); /* after the offload worker, which also queues to it */
+	audio->spectrum = NULL;
+}
+
+/* sample clock now, for main loop timers. Offline its the end of the last block,
+ * otherwise extend jacks 32 bit estimate of the current frame from the last published block */
+uint64_t audio_now(struct audio * audio){
+	unsigned seq;
+	uint64_t frame;
+	do {
+		seq = seq_read_begin(&audio->clock.seq);
+		frame = audio->clock.frame;
+	} while(seq_read_retry(&audio->clock.seq, seq));
+
+	if(audio->offline)
+		return frame;
+	jack_nframes_t now = jack_frame_time(audio->jclient);
+	if(!frame) /* nothing processed yet */
+		return now;
+	return frame + (int32_t)(now - (uint32_t)frame);
 }
 
-static int jack_process_frame (jack_nframes_t nframes, void *arg) {
-	struct audio * audio = (struct audio *)arg;
-	if(!audio->started){
-		audio->started = true; /* skip first frame */
-		return 0;
+/* set up a context in its hosts jack client: find its source ports, and build the channel bank with its ports.
+ * If none match yet it starts with no channels, and the port registration callback brings them in */
+int audio_init(struct audio * audio, struct host * host) {
+	audio->host = host;
+	audio->jclient = host->jclient;
+	audio->samplerate = host->samplerate;
+
+	/* the callbacks match every port registered against these */
+	if(regcomp(&audio->_sources_re, audio->sources, REG_EXTENDED | REG_NOSUB)){
+		fprintf(stderr, "Bad sources pattern \"%s\"\n", audio->sources);
+		return 1;
+	}
+	if(audio->level_sinks && regcomp(&audio->_sinks_re, audio->level_sinks, REG_EXTENDED | REG_NOSUB)){
+		fprintf(stderr, "Bad level_sinks pattern \"%s\"\n", audio->level_sinks);
+		return 1;
 	}
-	unsigned events=0;
 
-	pthread_mutex_lock(&audio->mutex);
-	for (int i=0; i < audio->channels; i++){
-		struct chan * c = &audio->chan[i];
-		jack_default_audio_sample_t *jbuf = jack_port_get_buffer(c->jport, nframes);
-		if(!jbuf)
-			goto done;
-		for(int s = 0; s < nframes; s++)
-			events += audio_chan_run(c, jbuf[s]);
+    /* get the list of source ports that match and are active */
+	if(!jack_find_source_ports(audio)){
+		fprintf(stderr, "Wait for ports matching \"%s\"...\n", audio->sources);
+		audio->disconnected = true;
 	}
-	if(events){
-		audio->event += events;
-		pthread_cond_broadcast(&audio->cond);
+
+    if(audio->level_sinks &&
+    		((audio->_level_sink_ports = jack_get_ports(audio->jclient, audio->level_sinks, NULL, JackPortIsInput)))) {
+    	for(int i = 0; audio->_level_sink_ports[i]; i++)
+    		debug(audio, "Route source %d -> sink %s when threshold is reached\n", i+1, audio->_level_sink_ports[i]);
+    }
+
+	if(audio_meter_init(audio) || (audio->spectrum && bands_start(audio->spectrum)))
+		return 1;
+	/* helpers at the priority of the thread they help */
+	if(audio->fanout && !((audio->pool = fanout_init(audio->fanout, audio->fanout_min, audio_meters_priority(audio)))))
+		return 1;
+	if(audio->offload && audio_offload_start(audio))
+		return 1;
+	return audio_bank_start(audio, audio_bank_build(audio, NULL));
+}
+
+/* realtime thread- level_gate. The gate follows the level edges of every channel in this block, and ramps all the
+ * output ports together. The routing never changes- the sinks stay connected to the outputs */
+static void audio_gate_process(struct audio * audio, const struct audio_bank * b, uint64_t frame, jack_nframes_t nframes){
+	int onset = -1, release = -1;
+	bool on = false;
+	for (unsigned i = 0; i < b->channels; i++){
+		const struct meter_state * s = &b->state[i];
+		on |= dsp_level_on(&audio->meter, s);
+		if(s->level_at >= 0 && (onset < 0 || s->level_at < onset))
+			onset = s->level_at;
+		if(s->release_at > release)
+			release = s->release_at;
 	}
-done:
-	pthread_mutex_unlock(&audio->mutex);
+	gate_run(&audio->gate, &audio->_gate, on, onset, release, frame, nframes);
+	for (unsigned i = 0; i < b->channels; i++){
+		float * out = jack_port_get_buffer(b->outs[i], nframes);
+		if(out)
+			gate_apply(&audio->gate, &audio->_gate, b->bufs[i], out, nframes);
+	}
+}
 
-	return 0;
+/* realtime thread- run this contexts ports for the cycle starting at sample clock frame, or with offload just queue
+ * them for the worker. The bank is read once here, and marked as in use so the main loop knows when it can free the
+ * one before- after carrying over from it, unless the worker does that */
+void audio_jack_process(struct audio * audio, uint64_t frame, jack_nframes_t nframes){
+	struct audio_bank * b = atomic_load_explicit(&audio->bank, memory_order_acquire);
+	if(!audio->worker && b->from) /* the worker owns it otherwise */
+		audio_bank_carry(b);
+	atomic_store_explicit(&audio->_bank_rt, b, memory_order_release);
+	for (unsigned i=0; i < b->channels; i++)
+		if(!((b->bufs[i] = jack_port_get_buffer(b->jports[i], nframes))))
+			return;
+	if(audio->worker){
+		offload_put(audio->worker, b, frame, b->bufs, b->channels, nframes);
+		return;
+	}
+	if(audio_bank_process(audio, b, frame, b->bufs, nframes))
+		audio_wake(audio);
+	if(audio->gate.en)
+		audio_gate_process(audio, b, frame, nframes);
 }
 
-static void jack_connect_cb(jack_port_id_t a, jack_port_id_t b, int connect, void *arg){
-	struct audio * audio = (struct audio *)arg;
-	if(connect) /* disconnects only */
+/* jack notification thread- a connection from source to sink, one of the clients ports, was removed. Flag a rescan
+ * if the source is one of ours. It goes by the pattern, not the bank, which the main loop may be swapping */
+void audio_jack_disconnect(struct audio * audio, const char * source, const char * sink){
+	if(regexec(&audio->_sources_re, source, 0, NULL, 0))
 		return;
+	fprintf(stderr, "\"%s\" -> \"%s\" Disconnected\n", source, sink);
+	if(audio->noreconnect)
+		exit (EXIT_FAILURE);
+	audio->resync = true;
+	audio_wake(audio);
+}
 
-	/* check if we disconnected any of audio->source_ports */
-    jack_port_t *src = jack_port_by_id(audio->jclient, a);
-    jack_port_t *snk = jack_port_by_id(audio->jclient, b);
-    if(!src || !snk)
-    	return;
-    const char *source = jack_port_name(src);
-    const char *sink = jack_port_name(snk);
-    if(!source || !sink)
-    	return;
-
-    for (int i=0; i < audio->channels; i++){
-    	if(!strcmp(source, audio->source_ports[i]) && !strcmp(sink, jack_port_name(audio->chan[i].jport))) {
-    		fprintf(stderr, "\"%s\" -> \"%s\" Disconnected\n", source, sink);
-    		if(audio->noreconnect)
-    			exit (EXIT_FAILURE);
-    		pthread_mutex_lock(&audio->mutex);
-    		audio->disconnected = true;
-    		pthread_cond_broadcast(&audio->cond);
-    		pthread_mutex_unlock(&audio->mutex);
-    		return;
-    	}
-    }
+/* jack notification thread- a port was registered (reg) or unregistered. Flag a rescan if it matches the sources or
+ * level_sinks, and note when the first source came for lat_ports */
+void audio_jack_port(struct audio * audio, const char * name, int flags, bool reg){
+	if((flags & JackPortIsOutput) && !regexec(&audio->_sources_re, name, 0, NULL, 0)){
+		if(reg){
+			struct timespec ts;
+			uint64_t none = 0;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			atomic_compare_exchange_strong(&audio->_appeared, &none, timespec_ns(&ts));
+		}
+		audio->resync = true;
+		audio_wake(audio);
+	} else if(audio->level_sinks && (flags & JackPortIsInput) && !regexec(&audio->_sinks_re, name, 0, NULL, 0)){
+		audio->_sinks_changed = true;
+		audio_wake(audio);
+	}
 }
 
-static void jack_shutdown (void *arg) {
-	exit (EXIT_FAILURE);
+/* jack notification thread- a client went, and its ports with it. Check ours are all still there */
+void audio_jack_client_gone(struct audio * audio){
+	audio->resync = true;
+	if(audio->level_sinks)
+		audio->_sinks_changed = true;
+	audio_wake(audio);
+}
+
+/* if pipe path was specified and not yet opened/created, do it here and now. Return fd to write or -1 */
+static int vu_open(struct audio * audio){
+	if(!audio->vu_pipe) /* just write stdout */
+		return STDOUT_FILENO;
+	if(!audio->h_vu_pipe){
+		if(((audio->h_vu_pipe = fifo_open(audio->vu_pipe))) <= 0){
+			fifo_close(audio->h_vu_pipe); /* cleanup handles */
+			audio->h_vu_pipe = 0;
+			return -1;
+		}
+	}
+	return audio->h_vu_pipe - 1;
 }
 
 /* hold file open until we get an error- in which case we close and try again the next time */
 void vu_print(struct audio * audio, const char* fmt, ...){
-	if(!gAudio.vu_ms)
+	if(!audio->vu_ms || vu_open(audio) < 0)
 		return;
-	
-	/* if pipe path was specified and not yet opened/created, do it here and now */
-	if(!gAudio.h_vu_pipe && gAudio.vu_pipe){
-		if(((gAudio.h_vu_pipe = fifo_open(gAudio.vu_pipe))) <= 0){
-			fifo_close(gAudio.h_vu_pipe); /* cleanup handles */
-			return;
-		}
-	}
 
 	va_list args;
 	va_start(args, fmt);
-	if(!gAudio.vu_pipe) /* just write stdout */
+	if(!audio->vu_pipe) /* just write stdout */
 		vfprintf(stdout, fmt, args);
-	else if(gAudio.h_vu_pipe > 0) /* hit the pipe */
-		vdprintf(gAudio.h_vu_pipe - 1, fmt, args);
+	else if(audio->h_vu_pipe > 0) /* hit the pipe */
+		vdprintf(audio->h_vu_pipe - 1, fmt, args);
 	va_end (args);
 }
 
+/* one binary frame of every channel- a single write so readers always see whole frames */
+void vu_write_frame(struct audio * audio, uint64_t now, unsigned flags){
+	int fd;
+	if(!audio->vu_ms || ((fd = vu_open(audio))) < 0)
+		return;
+
+	size_t size = audio->vu_format == VU_FORMAT_FLOAT ? sizeof(struct vu_float) : sizeof(struct vu_cdb);
+	size_t tail = (audio->loud ? sizeof(struct vu_loud) : 0) + (audio->spectrum ? sizeof(struct vu_bands) : 0);
+	size_t band_size = audio->spectrum ? audio->bands * (audio->vu_format == VU_FORMAT_FLOAT ? sizeof(float) : sizeof(int16_t)) : 0;
+	unsigned channels = audio->channels;
+	if(channels > (PIPE_BUF - sizeof(struct vu_frame) - tail) / (size + band_size))
+		channels = (PIPE_BUF - sizeof(struct vu_frame) - tail) / (size + band_size); /* keep it atomic */
+
+	uint8_t buf[PIPE_BUF];
+	struct vu_frame * h = (struct vu_frame *)buf;
+	h->magic = VU_FRAME_MAGIC;
+	h->seq = audio->_vu_seq++;
+	h->frame = now;
+	h->samplerate = audio->samplerate;
+	h->channels = channels;
+	h->format = audio->vu_format;
+	h->flags = flags | (audio->loud ? VU_FLAG_LOUD : 0) | (audio->spectrum ? VU_FLAG_BANDS : 0);
+	for (unsigned i = 0; i < channels; i++){
+		struct chan * c = &audio->chan[i];
+		if(audio->vu_format == VU_FORMAT_FLOAT){
+			struct vu_float * v = (struct vu_float *)(buf + sizeof(*h)) + i;
+			v->rms = c->rms_val;
+			v->peak = c->peak_val;
+		} else {
+			struct vu_cdb * v = (struct vu_cdb *)(buf + sizeof(*h)) + i;
+			v->rms = c->rms_val > min_level ? (int16_t)lrint(2000*flog(c->rms_val)) : INT16_MIN;
+			v->peak = c->peak_val > min_level ? (int16_t)lrint(2000*flog(c->peak_val)) : INT16_MIN;
+		}
+	}
+	if(audio->loud){
+		struct vu_loud * v = (struct vu_loud *)(buf + sizeof(*h) + channels * size);
+		v->m = audio->loud->val.m;
+		v->s = audio->loud->val.s;
+		v->i = audio->loud->val.i;
+		v->lra = audio->loud->val.lra;
+	}
+	size_t len = sizeof(*h) + channels * size + (audio->loud ? sizeof(struct vu_loud) : 0);
+	if(audio->spectrum){
+		float level[BANDS_MAX_CHANNELS * BANDS_MAX];
+		uint64_t periods;
+		unsigned bands = bands_get(audio->spectrum, level, &periods);
+		struct vu_bands * v = (struct vu_bands *)(buf + len);
+		v->bands = audio->bands;
+		v->channels = bands < channels ? bands : channels;
+		len += sizeof(*v);
+		for(unsigned i = 0; i < v->channels * audio->bands; i++)
+			if(audio->vu_format == VU_FORMAT_FLOAT){
+				memcpy(buf + len, &level[i], sizeof(float));
+				len += sizeof(float);
+			} else {
+				int16_t cdb = level[i] > min_level ? (int16_t)lrint(2000*flog(level[i])) : INT16_MIN;
+				memcpy(buf + len, &cdb, sizeof(cdb));
+				len += sizeof(cdb);
+			}
+	}
+	if(write(fd, buf, len) < 0 && errno != EAGAIN && audio->vu_pipe){
+		fifo_close(audio->h_vu_pipe); /* try again next time */
+		audio->h_vu_pipe = 0;
+	}
+}
+
 /* 40 cols*/
 void vu_print_header(struct audio * audio){
 	/* top left, clear page, disable cursor */
@@ -288,54 +836,75 @@ void vu_print_pretty(struct audio * audio, ftype rms, ftype peak, int chan){
 		vu_print(audio, "\n\r\x1b[2K%s", line); /* one line down, clear line */
 }
 
-/* wait for specified port list to be available */
-void jack_wait_for_source_ports(struct audio * audio) {
-	if(!audio->sources) /* nothing to wait for */
-		return;
-reconnect:;
-	bool waiting = false;
+/* refresh the list of source ports. return true if any match */
+static bool jack_find_source_ports(struct audio * audio){
 	if(audio->source_ports)
 		jack_free(audio->source_ports);
-	while(!((audio->source_ports=jack_get_ports(audio->jclient, audio->sources, NULL, JackPortIsOutput)))) {
-		if(!waiting){
-			fprintf(stderr, "Wait for ports matching \"%s\"...\n", audio->sources);
-			waiting = true;
-		}
-		millisleep(500);
+	return ((audio->source_ports = jack_get_ports(audio->jclient, audio->sources, NULL, JackPortIsOutput)));
+}
+
+/* level_gate- connect each channels output to its level sink, for good. The sink goes by port number, as in
+ * monitor_connect_sinks(). Already connected ones are left */
+static void jack_connect_gate_ports(struct audio * audio){
+	const struct audio_bank * b = atomic_load_explicit(&audio->bank, memory_order_relaxed);
+	unsigned sinks = 0;
+	if(!audio->_level_sink_ports)
+		return;
+	while(audio->_level_sink_ports[sinks])
+		sinks++;
+	for (unsigned i = 0; i < b->channels; i++){
+		if(!b->outs[i] || b->port[i] > sinks)
+			continue;
+		const char * out = jack_port_name(b->outs[i]), * snk = audio->_level_sink_ports[b->port[i] - 1];
+		if(!jack_connect(audio->jclient, out, snk))
+			debug(audio, "connect %s to %s\n", out, snk);
 	}
-	if(waiting) /* allow another 500ms to allow all the ports to appear after we see at least one matching */
-		goto reconnect;
 }
 
 void jack_connect_source_ports(struct audio * audio){
+	const struct audio_bank * b = atomic_load_explicit(&audio->bank, memory_order_relaxed);
 	/* make the connections */
-	for (int i = 0; i < audio->channels; i++){
-		struct chan * c = &audio->chan[i];
-		jack_connect(audio->jclient, audio->source_ports[i], jack_port_name(c->jport));
-		debug("connect %s to %s\n", audio->source_ports[i], jack_port_name(c->jport));
+	for (unsigned i = 0; i < b->channels; i++){
+		jack_connect(audio->jclient, b->sources[i], jack_port_name(b->jports[i]));
+		debug(audio, "connect %s to %s\n", b->sources[i], jack_port_name(b->jports[i]));
 	}
+	if(audio->level_gate)
+		jack_connect_gate_ports(audio);
 }
 
-/* if source ports become disabled, deactivate the jack client, and wait till the ports reappear.
- * Note this does not change the channel count if more matching source channels appear.
- * The channel count is set when this application is started */
-void jack_check_source_ports(struct audio * audio){
-	if(!audio->disconnected)
-		return;
-
-	if(audio->jack_activated){
-		jack_deactivate(audio->jclient);
-		audio->jack_activated = false;
-		debug("Deactivating client until source ports reappear");
+/* after the callbacks flag a change, swap in a channel bank for the source ports that match now and connect them,
+ * and find the level sinks again. Called from the main loop- never blocks. The client keeps running throughout, so
+ * channels whose source is still there never stop metering. With none left the actions are turned off until a
+ * registration brings some back. Ports of a device come one callback each, so the bank may grow a channel at a time */
+void jack_check_ports(struct audio * audio){
+	if(atomic_exchange(&audio->_sinks_changed, false)){
+		if(audio->_level_sink_ports)
+			jack_free(audio->_level_sink_ports);
+		audio->_level_sink_ports = jack_get_ports(audio->jclient, audio->level_sinks, NULL, JackPortIsInput);
+		audio->ports_changed++;
+		if(audio->level_gate)
+			jack_connect_gate_ports(audio);
 	}
-	jack_wait_for_source_ports(audio); /* blocks */
 
-	/* reactivate */
-	if (jack_activate (audio->jclient)) {
-		perror("cannot activate client");
+	if(!atomic_exchange(&audio->resync, false))
+		return;
+	if(!jack_find_source_ports(audio)){
+		if(!audio->disconnected)
+			debug(audio, "No source ports match \"%s\"- waiting for them\n", audio->sources);
+		audio->disconnected = true;
+		return;
+	}
+	if(audio_bank_swap(audio)){
+		audio->resync = true; /* the last bank is still retiring- next poll */
 		return;
 	}
-	audio->jack_activated = true;
 	audio->disconnected = false;
 	jack_connect_source_ports(audio);
+
+	uint64_t appeared = atomic_exchange(&audio->_appeared, 0);
+	if(appeared){
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		hist_add(&audio->lat_ports, timespec_ns(&ts) - appeared);
+	}
 }
@@ -9,6 +9,7 @@
 #define AUDIO_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <float.h>
 #include <math.h>
 #include <jack/jack.h>
@@ -16,52 +17,94 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <regex.h>
 
 #include "utils.h"
+#include "dsp.h"
+#include "gpio.h"
+#include "vu.h"
+#include "loudness.h"
+#include "bands.h"
+#include "offload.h"
+#include "fanout.h"
+
+struct host;
+struct vushm_hdr;
+
+/* per channel values published by the realtime thread each process cycle.
+ * Guarded by seq so the realtime thread never waits on the main loop. One per cache line, so publishing a
+ * channel doesn't bounce the line the main loop is reading the next one from */
+struct chan_snap {
+	_Alignas(CACHELINE) atomic_uint seq;
+	ftype rms;
+	ftype peak;
+	unsigned clips; /* running count of clip events */
+	unsigned events; /* running count of all events */
+	ftype win; /* windowed level detector- mean square of the latest window */
+};
 
-struct biquad {
-	ftype b0, b1, b2;
-	ftype a1, a2;
-	ftype z1, z2;
-	ftype y;
+/* sample clock- frame count at the end of the last processed block, published by the realtime thread.
+ * 64 bit so it needs the seqlock on 32 bit targets */
+struct audio_clock {
+	atomic_uint seq;
+	uint64_t frame;
 };
 
-struct rms {
-	bool en;
-	struct biquad f;
-	ftype _sum_squared; /* current sum squared */
+/* sample accurate event from the realtime thread: the cycle it happened in and the offset in its buffer */
+enum audio_event_type {
+	AUDIO_EVENT_CLIP,
+	AUDIO_EVENT_PEAK, /* new peak- not hold expiry */
+	AUDIO_EVENT_LEVEL, /* level detector onset- over level_thres */
+	AUDIO_EVENT_RELEASE, /* and release- under level_release */
 };
 
-struct peak {
-	ftype peak; /* output peak */
-	unsigned hold_time;
-	struct timespec _hold; /* peak hold timer */
-	ftype _peak; /* decaying peak value to comare new samples, and update for when peak hold expires if we don't exceed it */
-	unsigned decay_samples; /* number of samples to decay over */
-	ftype decay_atten; /* final value to decay to after samples - eg 0.001 */
-	ftype _decay; /* constant decay multiplier per sample */
-	bool event; /* set here, cleared by background loop */
+struct audio_event {
+	uint64_t frame; /* sample clock at the start of the cycle */
+	uint32_t offset; /* sample in the cycle */
+	uint16_t chan;
+	uint8_t type; /* enum audio_event_type */
+	uint8_t bank; /* low bits of the gen of the bank chan is an index in */
 };
 
-struct clip {
-	bool event; /* set here, cleared by background loop */
-	unsigned n; /* consecutive clipped samples */
-	unsigned threshold; /* number of consecutive samples overloaded to flag clip */
+/* single producer (realtime thread), single consumer (main loop) ring. Full drops the newest */
+#define AUDIO_EVENTS 256
+struct audio_events {
+	_Alignas(CACHELINE) atomic_uint head; /* realtime thread writes */
+	atomic_uint dropped;
+	_Alignas(CACHELINE) atomic_uint tail; /* main loop writes */
+	struct audio_event ev[AUDIO_EVENTS];
 };
 
-/* per channel */
-struct chan {
-	/* mutex protected data */
-	struct rms rms;
-	struct peak peak;
-	struct clip clip;
-	jack_port_t *jport;
+/* channel bank- arrays of channels split by which thread writes them, so they don't share cache lines.
+ * Built on the main loop and swapped in whole, so channels come and go with their sources while the
+ * rest keep metering. A channel keeps its port and state for as long as its source is there, wherever it ends up
+ * in the bank */
+struct audio_bank {
+	unsigned channels;
+	unsigned gen; /* banks swapped in before this one */
+	char ** sources; /* source port connected to each channel- NULL offline */
+	unsigned * port; /* our port number for each channel, from 1- 0 offline */
+	jack_port_t ** jports; /* our input ports */
+	jack_port_t ** outs; /* level_gate output ports- NULL without */
+	struct meter_state * state; /* realtime thread- hot filter state */
+	struct chan_snap * snap; /* realtime thread writes, main loop reads */
+	const float ** bufs; /* realtime thread- port buffers for this cycle */
+	const float ** wbufs; /* offload worker- this cycles channels in its ring */
+	int * prev; /* index of each channel in the bank before, -1 if new */
+	int * next; /* index in this bank of each channel of the bank before, -1 if it went */
+	unsigned prev_channels; /* in the bank before */
+	struct audio_bank * from; /* carry state over from- the thread running the meters copies it on its first cycle */
+};
 
-	/* double buffered state */
-	int pending;
+/* per channel- main loop copy of the last consistent snapshot */
+struct chan {
 	ftype rms_val;
 	ftype peak_val;
 	bool clip_event;
+	ftype win_val; /* windowed level, rms */
+	bool level; /* level detector on- from onset and release events */
+	unsigned _clips; /* snap.clips seen so far */
+	unsigned _events; /* snap.events seen so far */
 };
 
 struct audio {
@@ -69,11 +112,23 @@ struct audio {
 	char * name;
 	char * server;
 	char * config; /* ini style config file */
+	char * config_dir; /* host mode- run a context for every *.conf in here */
 	char * sources; /* name of source plugin as a regex to determine number of channels */
 	char * level_sinks; /* name of sink plugin as a regex to connect source when level is reached */
 	bool debug;
 	bool noreconnect; /* dont try to reconnect if input link disconnected */
+	unsigned profile; /* seconds between process callback load reports, 0 for off */
+	bool offload; /* the process callback only copies the ports, a worker thread runs the meters */
+	unsigned offload_ms; /* most the worker may fall behind- cycles past it are dropped */
+	int offload_priority; /* worker realtime priority- default one under jacks, negative for normal scheduling */
+	unsigned long offload_cpus; /* mask of CPUs to pin the worker to, 0 for any */
+	unsigned fanout; /* realtime helper threads to split the channels with, 0 for none */
+	unsigned fanout_min; /* fewer channels than this run serially */
 	char * vu_pipe; /* name of file to write VU stream */
+	char * vu_shm; /* shared memory meter ring in /dev/shm for any number of readers- see vushm.h */
+	bool true_peak; /* 4x oversampled inter-sample peak for peak and clip */
+	bool loudness; /* BS.1770 loudness in the VU stream */
+	unsigned bands; /* 10 octave or 31 third octave band levels in the VU stream, 0 off */
 	unsigned vu_ms; /* ms poll rate for VU updates- events will update faster */
 	unsigned vu_peak_hold_ms; /* ms to hold peak value */
 	char * clip_cmd; /* script to run -eg trigger a one-shot LED */
@@ -84,171 +139,92 @@ struct audio {
 	unsigned level_sec; /* time to hold after level collases below threshold */
 	char * level_cmd; /* call this with env LEVEL=1 for on, 0 for off- eg pump into a GPIO directly */
 	ftype level_thres; /* threshold for setting level/hold */
+	ftype level_release; /* the level is released under this, for hysteresis- default level_thres. Hold starts then */
+	unsigned level_window_ms; /* detect level on the mean square of windows this long, instead of the rms meter */
+	unsigned level_windows; /* consecutive windows over level_thres to trigger- default 1 */
 	struct gpio_info level_gpio; /* sysfs GPIO to control level... negative means active low */
+	bool level_gate; /* pass each source through an output port with a gain gate on the trigger, connected to level_sinks for good */
+	unsigned level_gate_ms; /* gate ramp time */
+	char * gpio_root; /* sysfs gpio directory, default /sys/class/gpio- eg a fake tree for testing */
+	char * gpio_chip; /* use this character device, eg gpiochip0, instead of sysfs. GPIOs are line offsets on it */
 
 	/* which functions are enabled based on config */
 	bool rms_en; /* enable rms calculations */
 	bool clip_en; /* enable clipping detection */
 	bool vu_pretty;
+	enum vu_format vu_format; /* vu_pipe stream format- text by default */
 
 	/* evaluated */
+	struct host * host; /* shared jack client this context runs in- NULL offline */
 	jack_client_t * jclient;
 	/* from connection */
 	ftype samplerate;
 	const char ** source_ports; /* list of source ports we are connecting to */
 	int h_vu_pipe; /* VU pipe handle */
-	bool disconnected; /* flag indicating source port disconnected */
-	bool jack_activated; /* flag that client is active */
-	struct chan * chan; /* pointer to array of stats- one per channel */
-	unsigned channels;
-	bool started;
-	pthread_cond_t cond;
-	pthread_mutex_t mutex;
-	unsigned event; /* event to wake up main thread- eg clip, or peak */
-
-	struct timespec _clip_hold;
-	struct timespec _level_hold; /* timer to hold after level trigger */
+	uint32_t _vu_seq; /* binary frame count */
+	struct vushm_hdr * _Atomic shm; /* mapped meter ring- realtime thread writes. NULL while the bank is resized */
+	struct vushm_hdr * _shm_map; /* main loop- the mapping, kept while shm is NULL */
+	size_t shm_size;
+	atomic_bool resync; /* a matching source port came, went or was disconnected- rescan them */
+	atomic_bool _sinks_changed; /* a matching sink port came or went- find them again */
+	_Atomic uint64_t _appeared; /* monotonic ns the first matching source port registered, for lat_ports- 0 for none */
+	regex_t _sources_re, _sinks_re; /* sources and level_sinks, as jack_get_ports() matches them */
+	bool disconnected; /* no source ports left- actions are turned off until some come back */
+	unsigned channels; /* main loops view- the bank it last swapped in */
+	struct meter meter; /* meter config, shared by all channels */
+	struct gate gate; /* level_gate config */
+	struct gate_state _gate; /* realtime thread only */
+	struct audio_bank * _Atomic bank; /* realtime thread reads it at the start of each cycle */
+	struct audio_bank * _Atomic _bank_rt; /* the bank the realtime thread last started a cycle with */
+	struct audio_bank * _retired; /* swapped out- freed once the realtime thread is off it */
+	bool _shm_reopen; /* lay the meter ring out again for the new channel count once retired */
+	unsigned ports_changed; /* banks swapped in or sinks found again- the monitor resyncs on a change */
+	struct hist lat_ports; /* source port registered to connected */
+	struct chan * chan; /* main loop only */
+	struct audio_clock clock; /* realtime thread writes, main loop reads */
+	struct audio_events * events; /* realtime thread writes, main loop reads */
+	struct loudness * loud; /* realtime thread queues 100ms blocks, main loop integrates */
+	struct bands * spectrum; /* realtime thread queues cycles, the worker filters, main loop reads the levels */
+	struct offload * worker; /* offload = 1- realtime thread queues cycles, the worker runs the meters on them */
+	pthread_t _worker;
+	struct fanout * pool; /* fanout helpers- NULL for none */
+	int h_wake; /* eventfd to wake up main thread- eg clip, or peak */
+	atomic_bool wake_pending; /* limit realtime thread to one eventfd write per main loop wake up */
+
+	bool offline; /* replaying files- no jack client, monitor prints events instead of acting on them */
 	const char ** _level_sink_ports; /* array of sink names determined on open */
 };
 
-static inline void run_biquad(ftype x, struct biquad * b){
-	ftype y = b->b0 * x + b->z1;
-	if(y < min_level*min_level) /* below noise floor (mean squared, so ^2)*/
-		b->y = b->z1 = b->z2 = 0.0;
-	else {
-		b->z1 = b->b1 * x - b->a1 * y + b->z2;
-		b->z2 = b->b2 * x - b->a2 * y;
-	    b->y = y;
-	}
-}
-
-void rms_init(struct rms * rms, double samplerate);
-
-/* return 1 if RMS value becomes ready */
-static inline int rms_run(struct rms * rms, ftype sample) {
-	if(!rms->en)
-		return 0; /* disabled */
-	run_biquad(sample*sample, &rms->f);
-	return rms->f.y != 0.0;
-}
-
-/* call from background within critical section */
-
-static inline ftype rms_get(struct rms * rms){
-	return rms->f.y ? sqrtff(rms->f.y) : 0.0;
-}
-
-
-void peak_init(struct peak * peak, ftype atten, unsigned decay_samples, unsigned hold_ms);
-
-/* track max sample for hold_time ms, with a decay used after timer expires.
- * return 1 if peak changes */
-static inline int peak_run(struct peak * peak, ftype sample){
-	if(sample < min_level) /* flatten it */
-		sample = 0;
-
-	if(!peak->hold_time) {
-		if(sample >= peak->peak)
-			peak->peak = sample;
-		else if (sample > 0)
-			peak->peak *= peak->_decay;
-		else
-			peak->peak = 0.0;
-		return 0; /* never trigger events with no hold timer */
-	}
-
-	/* use the peak hold timer */
-	if(sample >= peak->peak){
-		peak->peak = peak->_peak = sample;
-		goto peak_detected;
-	}
-
-	/* get next peak after peak hold expires */
-	if(sample >= peak->_peak)
-		peak->_peak = sample;
-	else if (sample > 0)
-		peak->_peak *= peak->_decay;
-	else
-		peak->_peak = 0.0;
-
-	if(!timer_poll(&peak->_hold)){
-		peak->peak = peak->_peak;
-		goto peak_detected;
-	}
-
-	return 0;
-
-peak_detected:
-	set_timer(&peak->_hold, peak->hold_time);
-	peak->event = true;
-	return 1;
-}
-
-/* grab peak value. return true if peak value updated on hold timer. */
-static inline bool peak_get(struct peak * peak, ftype * val){
-	*val = peak->peak;
-	if(peak->event)
-		return false;
-	peak->event = false;
-	return true;
-}
-
-void clip_init(struct clip * clip, unsigned threshold);
-
-/* flag clip if overloaded mode than threshold samples in a row.
- * If we triggered event, return 1, otherwise 0 */
-static inline int clip_run(struct clip * clip, ftype sample){
-	if (sample >= 0.9999) {
-		if(++clip->n >= clip->threshold){
-			clip->event = true; /* cleared by background loop */
-			return 1;
-		}
-	} else
-		clip->n = 0;
-	return 0;
-}
-
-/* call from background within critical section - return true if clip tripped on this channel */
-static inline bool clip_get(struct clip * clip){
-	if(!clip->event)
-		return false;
-	clip->event = false;
-	return true;
-}
-
-/* process channel, return accumulated events for post processing */
-static inline int audio_chan_run(struct chan * s, ftype sample){
-	int ret = 0;
-	sample = ffabs(sample); /* only care for magnitude */
-	if(s->rms.en)
-		ret += rms_run(&s->rms, sample);
-	if(s->peak.decay_samples)
-		ret += peak_run(&s->peak, sample);
-	if(s->clip.threshold)
-		ret += clip_run(&s->clip, sample);
-	s->pending += ret;
-	return ret;
-}
-
-extern struct audio gAudio;
-
-/* include jack name in debug messages for journalctl */
-static inline void debug(const char* fmt, ...){
-	if(!gAudio.debug)
+/* include context name in debug messages for journalctl */
+static inline void debug(const struct audio * audio, const char* fmt, ...){
+	if(!audio->debug)
 		return;
-	fprintf(stderr, "(%s) ", gAudio.name);
+	fprintf(stderr, "(%s) ", audio->name);
 	va_list args;
 	va_start(args, fmt);
 	vfprintf(stderr, fmt, args);
 	va_end (args);
 }
 
-int audio_init(struct audio * audio);
-int audio_poll(struct audio * audio, unsigned period_ms);
+int audio_init(struct audio * audio, struct host * host);
+int audio_init_offline(struct audio * audio, ftype samplerate, unsigned channels);
+unsigned audio_process(struct audio * audio, uint64_t frame, const float * const * bufs, unsigned n);
+uint64_t audio_now(struct audio * audio);
+int audio_poll(struct audio * audio);
+bool audio_event_get(struct audio * audio, struct audio_event * ev);
+void audio_jack_process(struct audio * audio, uint64_t frame, jack_nframes_t nframes);
+void audio_jack_disconnect(struct audio * audio, const char * source, const char * sink);
+void audio_jack_port(struct audio * audio, const char * name, int flags, bool reg);
+void audio_jack_client_gone(struct audio * audio);
+void audio_wake(struct audio * audio);
+void audio_stop(struct audio * audio);
 void vu_print(struct audio * audio, const char* fmt, ...);
-void jack_wait_for_source_ports(struct audio * audio);
+void vu_write_frame(struct audio * audio, uint64_t now, unsigned flags);
+int vushm_open(struct audio * audio);
+void vushm_publish(struct vushm_hdr * h, const struct audio_bank * bank, uint64_t frame);
+void vushm_close(struct audio * audio);
 void jack_connect_source_ports(struct audio * audio);
-void jack_check_source_ports(struct audio * audio);
+void jack_check_ports(struct audio * audio);
 void vu_print_header(struct audio * audio);
 void vu_console_restore(struct audio * audio);
 void vu_print_pretty(struct audio * audio, ftype rms, ftype peak, int chan);
@@ -0,0 +1,268 @@
+/*
+ * bands.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Worker side of the band analyser- the filter bank, and its thread. See bands.h
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bands.h"
+
+/* RBJ cookbook band pass (0dB peak) and low pass, fc in the same units as rate */
+static void bands_bandpass(struct biquad * f, double fc, double q, double rate){
+	double w = 2.0 * M_PI * fc / rate, alpha = sin(w) / (2.0 * q), a0 = 1.0 + alpha;
+	f->b0 = alpha / a0;
+	f->b1 = 0.0;
+	f->b2 = -alpha / a0;
+	f->a1 = -2.0 * cos(w) / a0;
+	f->a2 = (1.0 - alpha) / a0;
+}
+
+static void bands_lowpass(struct biquad * f, double fc, double q, double rate){
+	double w = 2.0 * M_PI * fc / rate, alpha = sin(w) / (2.0 * q), a0 = 1.0 + alpha;
+	f->b0 = f->b2 = (1.0 - cos(w)) / 2.0 / a0;
+	f->b1 = (1.0 - cos(w)) / a0;
+	f->a1 = -2.0 * cos(w) / a0;
+	f->a2 = (1.0 - alpha) / a0;
+}
+
+/* bands 10 or 31, levels every period samples. IEC 61260 base 10 mid band frequencies: octaves 31.5Hz to 16kHz,
+ * third octaves 20Hz to 20kHz. Bands too close to nyquist for the samplerate read 0 */
+struct bands * bands_init(unsigned bands, double samplerate, unsigned period){
+	if(bands != 10 && bands != BANDS_MAX)
+		return NULL;
+	struct bands * b = aligned_calloc(1, sizeof(struct bands));
+	if(!b)
+		return NULL;
+	bool ok = (b->ring = aligned_calloc(BANDS_RING, sizeof(float)));
+	for(unsigned s = 0; s < BANDS_STAGES; s++)
+		ok = ok && (b->_buf[s] = aligned_calloc(BANDS_CHUNK, sizeof(float)));
+	if(!ok){
+		bands_free(b);
+		return NULL;
+	}
+	b->n = bands;
+	b->samplerate = samplerate;
+	b->period = period ?: samplerate / 20;
+
+	double g = pow(10.0, 0.3), per = bands == 10 ? 1.0 : 3.0; /* octave ratio, bands per octave */
+	int top = bands == 10 ? 4 : 13; /* x for the highest band, 1kHz at 0 */
+	for(unsigned i = 0; i < bands; i++){
+		struct band * d = &b->band[i];
+		double fc = 1000.0 * pow(g, (top - (int)i) / per), f1 = fc * pow(g, -0.5 / per), f2 = fc * pow(g, 0.5 / per);
+		double q = fc / (f2 - f1) * sqrt(M_SQRT2 - 1.0); /* each of the pair -1.5dB at the edges */
+		d->fc = fc;
+		if(fc >= 0.45 * samplerate){
+			d->stage = BANDS_STAGES; /* never run */
+			continue;
+		}
+		/* the lowest rate that has the band edge under a fifth of it, so its well inside the low pass */
+		while(d->stage + 1 < BANDS_STAGES && f2 <= 0.2 * samplerate / (2 << d->stage))
+			d->stage++;
+		double rate = samplerate / (1 << d->stage);
+		bands_bandpass(&d->bp[0], fc, q, rate);
+		d->bp[1] = d->bp[0];
+		if(d->stage + 1 > b->stages)
+			b->stages = d->stage + 1;
+	}
+	/* 6th order Butterworth at 0.15 of the rate- flat to the bands at the next rate, and 50dB down where it aliases onto them */
+	static const double lp_q[BANDS_LP] = { 0.51763809, 0.70710678, 1.93185165 };
+	for(unsigned l = 0; l < BANDS_LP; l++)
+		bands_lowpass(&b->lp[l], 0.15, lp_q[l], 1.0);
+	return b;
+}
+
+void bands_free(struct bands * b){
+	if(!b)
+		return;
+	for(unsigned s = 0; s < BANDS_STAGES; s++)
+		free(b->_buf[s]);
+	free(b->_chan);
+	free(b->ring);
+	free(b);
+}
+
+/* worker- new channel count, start again */
+static int bands_reset(struct bands * b, unsigned channels){
+	free(b->_chan);
+	b->_channels = 0;
+	b->_count = 0;
+	if(!((b->_chan = aligned_calloc(channels ?: 1, sizeof(struct bands_chan)))))
+		return 1;
+	b->_channels = channels;
+	return 0;
+}
+
+/* sum of squares of x[0..n) through a bands pair of biquads, with the state in registers */
+static inline ftype bands_sum(const struct band * d, struct biquad_state * s, const float * x, unsigned n){
+	const struct biquad * a = &d->bp[0], * c = &d->bp[1];
+	ftype az1 = s[0].z1, az2 = s[0].z2, cz1 = s[1].z1, cz2 = s[1].z2;
+	ftype sum = 0.0;
+	for(unsigned i = 0; i < n; i++){
+		ftype v = x[i];
+		ftype y = a->b0 * v + az1; /* b1 = 0, b2 = -b0 */
+		az1 = -a->a1 * y + az2;
+		az2 = -a->b0 * v - a->a2 * y;
+		v = y;
+		y = c->b0 * v + cz1;
+		cz1 = -c->a1 * y + cz2;
+		cz2 = -c->b0 * v - c->a2 * y;
+		sum += y * y;
+	}
+	/* flush state below the noise floor rather than let silence decay into denormals */
+	if(ffabs(az1) + ffabs(az2) < min_level)
+		az1 = az2 = 0.0;
+	if(ffabs(cz1) + ffabs(cz2) < min_level)
+		cz1 = cz2 = 0.0;
+	s[0].z1 = az1;
+	s[0].z2 = az2;
+	s[1].z1 = cz1;
+	s[1].z2 = cz2;
+	return sum;
+}
+
+/* low pass x[0..n) and keep every other sample in y. return samples in y */
+static unsigned bands_decimate(const struct bands * b, struct bands_chan * s, unsigned stage, const float * x, float * y, unsigned n){
+	struct biquad_state * z = s->lp[stage];
+	bool phase = s->phase[stage];
+	unsigned k = 0;
+	for(unsigned i = 0; i < n; i++){
+		ftype v = x[i];
+		for(unsigned l = 0; l < BANDS_LP; l++){
+			const struct biquad * f = &b->lp[l];
+			ftype o = f->b0 * v + z[l].z1;
+			z[l].z1 = f->b1 * v - f->a1 * o + z[l].z2;
+			z[l].z2 = f->b2 * v - f->a2 * o;
+			v = o;
+		}
+		if((phase = !phase))
+			y[k++] = v;
+	}
+	for(unsigned l = 0; l < BANDS_LP; l++)
+		if(ffabs(z[l].z1) + ffabs(z[l].z2) < min_level)
+			z[l].z1 = z[l].z2 = 0.0;
+	s->phase[stage] = phase;
+	return k;
+}
+
+/* one channels chunk of n samples in _buf[0], down through the stages */
+static void bands_chan_run(struct bands * b, struct bands_chan * s, unsigned n){
+	for(unsigned st = 0; st < b->stages && n; st++){
+		const float * x = b->_buf[st];
+		s->count[st] += n;
+		for(unsigned j = 0; j < b->n; j++)
+			if(b->band[j].stage == st)
+				s->sum[j] += bands_sum(&b->band[j], s->bp[j], x, n);
+		if(st + 1 < b->stages)
+			n = bands_decimate(b, s, st, x, b->_buf[st + 1], n);
+	}
+}
+
+/* a period is done- publish the rms of each band, lowest first, and start the next */
+static void bands_publish(struct bands * b){
+	seq_write_begin(&b->snap.seq);
+	for(unsigned c = 0; c < b->_channels; c++){
+		struct bands_chan * s = &b->_chan[c];
+		for(unsigned j = 0; j < b->n; j++){
+			unsigned st = b->band[j].stage;
+			b->snap.level[c * b->n + b->n - 1 - j] = st < b->stages && s->count[st] ? sqrtff(s->sum[j] / s->count[st]) : 0.0f;
+			s->sum[j] = 0.0;
+		}
+		memset(s->count, 0, sizeof(s->count));
+	}
+	b->snap.channels = b->_channels;
+	b->snap.periods++;
+	seq_write_end(&b->snap.seq);
+}
+
+/* worker- analyse the cycles queued since last time. return the number of periods published */
+unsigned bands_run(struct bands * b){
+	unsigned tail = atomic_load_explicit(&b->tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(&b->head, memory_order_acquire), published = 0;
+	for(; tail != head; tail++){
+		struct bands_block k = b->block[tail % BANDS_BLOCKS];
+		if(k.channels == b->_channels || !bands_reset(b, k.channels))
+			for(unsigned off = 0; off < k.n;){
+				unsigned len = k.n - off;
+				if(len > b->period - b->_count)
+					len = b->period - b->_count;
+				if(len > BANDS_CHUNK)
+					len = BANDS_CHUNK;
+				for(unsigned c = 0; c < k.channels; c++){
+					uint32_t at = (k.pos + c * k.n + off) % BANDS_RING, first = BANDS_RING - at < len ? BANDS_RING - at : len;
+					memcpy(b->_buf[0], b->ring + at, first * sizeof(float));
+					memcpy(b->_buf[0] + first, b->ring, (len - first) * sizeof(float));
+					bands_chan_run(b, &b->_chan[c], len);
+				}
+				off += len;
+				if((b->_count += len) == b->period){
+					bands_publish(b);
+					published++;
+					b->_count = 0;
+				}
+			}
+		atomic_store_explicit(&b->pos_tail, k.pos + k.channels * k.n, memory_order_release);
+		atomic_store_explicit(&b->tail, tail + 1, memory_order_release);
+	}
+	return published;
+}
+
+static void * bands_thread(void * arg){
+	struct bands * b = arg;
+	while(!atomic_load_explicit(&b->stop, memory_order_acquire)){
+		bands_run(b);
+		millisleep(10);
+	}
+	return NULL;
+}
+
+/* start the worker- normal priority, it only has to keep up on average */
+int bands_start(struct bands * b){
+	if((errno = pthread_create(&b->_thread, NULL, bands_thread, b))){
+		perror("band analyser thread");
+		return 1;
+	}
+	b->_started = true;
+	return 0;
+}
+
+/* stop the worker and free. Not while the realtime thread can still queue to it */
+void bands_stop(struct bands * b){
+	if(!b)
+		return;
+	if(b->_started){
+		atomic_store_explicit(&b->stop, true, memory_order_release);
+		pthread_join(b->_thread, NULL);
+	}
+	bands_free(b);
+}
+
+/* main loop- copy the latest levels, channels x bands. return the channels */
+unsigned bands_get(struct bands * b, float * level, uint64_t * periods){
+	unsigned seq, channels;
+	do {
+		seq = seq_read_begin(&b->snap.seq);
+		channels = b->snap.channels < BANDS_MAX_CHANNELS ? b->snap.channels : BANDS_MAX_CHANNELS;
+		*periods = b->snap.periods;
+		memcpy(level, b->snap.level, channels * b->n * sizeof(float));
+	} while(seq_read_retry(&b->snap.seq, seq));
+	return channels;
+}
+
+void bands_print(struct bands * b, const char * prefix, FILE * fp){
+	float level[BANDS_MAX_CHANNELS * BANDS_MAX];
+	uint64_t periods;
+	bands_get(b, level, &periods);
+	fprintf(fp, "%sband analyser %u bands, %llu levels", prefix, b->n, (unsigned long long)periods);
+	unsigned dropped = atomic_load_explicit(&b->dropped, memory_order_relaxed);
+	if(dropped)
+		fprintf(fp, ", %u cycles dropped", dropped);
+	fprintf(fp, "\n");
+}
@@ -0,0 +1,127 @@
+/*
+ * bands.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Band analyser, bands = 10 (octaves) or 31 (third octaves) in the config, for a spectrum display on the VU output.
+ * The realtime thread only copies each cycle into a ring here. A worker thread at normal priority runs them through
+ * an IIR filter bank- each band is two band pass biquads, 4th order with its -3dB points on the IEC 61260 band edges.
+ * Each octave down runs at half the rate of the one above, after a 6th order low pass, so the whole bank costs about
+ * twice the top octave. The rms of every band over each vu_ms of samples is published for the main loop.
+ */
+
+#ifndef BANDS_H_
+#define BANDS_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils.h"
+#include "dsp.h"
+
+#define BANDS_MAX 31
+#define BANDS_MAX_CHANNELS 64 /* channels past this aren't analysed */
+#define BANDS_RING (1 << 18) /* samples- 40ms of 64 channels at 96k, the worker takes them every 10ms */
+#define BANDS_BLOCKS 256 /* cycles in the ring */
+#define BANDS_STAGES 12 /* rates, halving each time */
+#define BANDS_CHUNK 1024 /* samples the worker filters at a time */
+#define BANDS_LP 3 /* biquads in the decimation low pass */
+
+/* one cycle in the ring- channels of n samples one after the other from pos */
+struct bands_block {
+	uint32_t pos;
+	uint16_t channels;
+	uint32_t n;
+};
+
+struct band {
+	float fc; /* centre, Hz */
+	unsigned stage; /* runs at samplerate / 2^stage */
+	struct biquad bp[2];
+};
+
+/* worker, per channel */
+struct bands_chan {
+	struct biquad_state bp[BANDS_MAX][2];
+	struct biquad_state lp[BANDS_STAGES][BANDS_LP];
+	bool phase[BANDS_STAGES]; /* decimation- keep every other low pass output */
+	ftype sum[BANDS_MAX]; /* sum of squares this period */
+	unsigned count[BANDS_STAGES]; /* samples this period at each stage */
+};
+
+/* main loop copy. Levels are rms, linear, each channels lowest band first */
+struct bands_snap {
+	atomic_uint seq;
+	unsigned channels;
+	uint64_t periods; /* published so far */
+	float level[BANDS_MAX_CHANNELS * BANDS_MAX];
+};
+
+struct bands {
+	/* single producer (realtime thread), single consumer (worker) ring of cycles */
+	_Alignas(CACHELINE) atomic_uint head; /* blocks */
+	uint32_t _pos; /* realtime thread- next sample */
+	atomic_uint dropped; /* cycles that didn't fit */
+	_Alignas(CACHELINE) atomic_uint tail; /* blocks */
+	atomic_uint pos_tail; /* samples the worker is done with */
+	struct bands_block block[BANDS_BLOCKS];
+	float * ring;
+
+	/* config */
+	_Alignas(CACHELINE) unsigned n; /* bands */
+	unsigned stages;
+	unsigned period; /* samples per published level */
+	double samplerate;
+	struct band band[BANDS_MAX]; /* highest first, so by stage */
+	struct biquad lp[BANDS_LP]; /* at 0.15 of the rate its decimating from- the same at every stage */
+
+	/* worker only */
+	unsigned _channels;
+	struct bands_chan * _chan;
+	unsigned _count; /* samples so far this period */
+	float * _buf[BANDS_STAGES]; /* each stages input for a chunk */
+
+	struct bands_snap snap; /* worker writes, main loop reads */
+
+	/* main loop */
+	pthread_t _thread;
+	bool _started;
+	atomic_bool stop;
+};
+
+/* realtime thread- queue a cycle of n samples per channel. Full drops it */
+static inline void bands_put(struct bands * b, const float * const * bufs, unsigned channels, unsigned n){
+	unsigned head = atomic_load_explicit(&b->head, memory_order_relaxed);
+	if(channels > BANDS_MAX_CHANNELS)
+		channels = BANDS_MAX_CHANNELS;
+	uint32_t need = channels * n, pos = b->_pos;
+	if(!need)
+		return;
+	if(head - atomic_load_explicit(&b->tail, memory_order_acquire) >= BANDS_BLOCKS ||
+			pos - atomic_load_explicit(&b->pos_tail, memory_order_acquire) + need > BANDS_RING){
+		atomic_fetch_add_explicit(&b->dropped, 1, memory_order_relaxed);
+		return;
+	}
+	for(unsigned c = 0; c < channels; c++){
+		uint32_t at = (pos + c * n) % BANDS_RING, first = BANDS_RING - at < n ? BANDS_RING - at : n;
+		memcpy(b->ring + at, bufs[c], first * sizeof(float));
+		memcpy(b->ring, bufs[c] + first, (n - first) * sizeof(float));
+	}
+	b->block[head % BANDS_BLOCKS] = (struct bands_block){ .pos = pos, .channels = channels, .n = n };
+	b->_pos = pos + need;
+	atomic_store_explicit(&b->head, head + 1, memory_order_release);
+}
+
+struct bands * bands_init(unsigned bands, double samplerate, unsigned period);
+void bands_free(struct bands * b);
+unsigned bands_run(struct bands * b);
+int bands_start(struct bands * b);
+void bands_stop(struct bands * b);
+unsigned bands_get(struct bands * b, float * level, uint64_t * periods);
+void bands_print(struct bands * b, const char * prefix, FILE * fp);
+
+#endif /* BANDS_H_ */
@@ -0,0 +1,492 @@
+/*
+ * bench.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Microbenchmarks for the DSP hot path- no jack needed.
+ * Built once per ftype (bench-double, bench-float) by make bench.
+ * Reports ns/sample and cycles/sample for each case over a sweep of block sizes and channel counts.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "dsp.h"
+#include "bands.h"
+#include "offload.h"
+#include "fanout.h"
+#include "utils.h"
+
+#define MAX_SWEEP 16
+
+static unsigned sweep_frames[MAX_SWEEP] = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+static unsigned n_frames = 9;
+static unsigned sweep_chans[MAX_SWEEP] = { 1, 2, 8, 32, 128 };
+static unsigned n_chans = 5;
+static unsigned min_ms = 20; /* run each measurement for at least this long */
+static const char * only; /* run cases matching this name */
+static double fs = 48000.0; /* meters are set up for this rate */
+
+/* buffers and meters for the largest sweep point */
+static float * bufs;
+static float * outs; /* gate output */
+static struct meter meter;
+static struct meter_state * state;
+static uint64_t frame; /* sample clock, advanced every pass */
+
+/* cycle counter- hardware cycles from perf if we are allowed, or the TSC on x86 */
+static int perf_fd = -1;
+static const char * cycle_src = "none";
+
+static void cycles_init(void){
+	struct perf_event_attr pe = {
+		.type = PERF_TYPE_HARDWARE,
+		.size = sizeof(pe),
+		.config = PERF_COUNT_HW_CPU_CYCLES,
+		.exclude_kernel = 1,
+		.exclude_hv = 1,
+	};
+	if((perf_fd = syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0)) >= 0){
+		cycle_src = "perf";
+		return;
+	}
+#if defined(__x86_64__)
+	cycle_src = "tsc";
+#endif
+}
+
+static uint64_t cycles(void){
+	if(perf_fd >= 0){
+		uint64_t c = 0;
+		if(read(perf_fd, &c, sizeof(c)) != sizeof(c))
+			return 0;
+		return c;
+	}
+#if defined(__x86_64__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static uint64_t nsecs(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/* one pass of a case over frames x chans samples. return a value so the work isn't optimised away */
+typedef ftype (*bench_fn)(unsigned frames, unsigned chans);
+
+static ftype b_run_lowpass(unsigned frames, unsigned chans){
+	ftype r = 0;
+	for(unsigned c = 0; c < chans; c++){
+		const float * x = bufs + c * frames;
+		struct lowpass_state * s = &state[c].rms.f;
+		for(unsigned i = 0; i < frames; i++)
+			run_lowpass(x[i], &meter.rms.f, s);
+		r += s->y;
+	}
+	return r;
+}
+
+static ftype b_rms_run(unsigned frames, unsigned chans){
+	ftype r = 0;
+	for(unsigned c = 0; c < chans; c++){
+		const float * x = bufs + c * frames;
+		for(unsigned i = 0; i < frames; i++)
+			rms_run(&meter.rms, &state[c].rms, ffabs(x[i]));
+		r += rms_get(&state[c].rms);
+	}
+	return r;
+}
+
+/* the rms detector without decimation- a biquad step every sample */
+static struct rms rms_full;
+
+static ftype b_rms_run_full(unsigned frames, unsigned chans){
+	struct rms rms = meter.rms;
+	meter.rms = rms_full;
+	ftype r = b_rms_run(frames, chans);
+	meter.rms = rms;
+	return r;
+}
+
+static ftype b_peak_run(unsigned frames, unsigned chans){
+	ftype r = 0;
+	for(unsigned c = 0; c < chans; c++){
+		const float * x = bufs + c * frames;
+		for(unsigned i = 0; i < frames; i++)
+			peak_run(&meter.peak, &state[c].peak, ffabs(x[i]), frame + i);
+		r += state[c].peak.peak;
+	}
+	frame += frames;
+	return r;
+}
+
+static ftype b_peak_run_nohold(unsigned frames, unsigned chans){
+	unsigned hold = meter.peak.hold_samples;
+	meter.peak.hold_samples = 0;
+	ftype r = b_peak_run(frames, chans);
+	meter.peak.hold_samples = hold;
+	return r;
+}
+
+static ftype b_clip_run(unsigned frames, unsigned chans){
+	ftype r = 0;
+	for(unsigned c = 0; c < chans; c++){
+		const float * x = bufs + c * frames;
+		for(unsigned i = 0; i < frames; i++)
+			r += clip_run(&meter.clip, &state[c].clip, ffabs(x[i]));
+	}
+	return r;
+}
+
+/* what the process callback used to do- every meter called per sample */
+static ftype b_sample_loop(unsigned frames, unsigned chans){
+	ftype r = 0;
+	for(unsigned c = 0; c < chans; c++){
+		const float * x = bufs + c * frames;
+		struct meter_state * s = &state[c];
+		for(unsigned i = 0; i < frames; i++){
+			ftype sample = ffabs(x[i]);
+			r += rms_run(&meter.rms, &s->rms, sample);
+			r += peak_run(&meter.peak, &s->peak, sample, frame + i);
+			r += clip_run(&meter.clip, &s->clip, sample);
+		}
+	}
+	frame += frames;
+	return r;
+}
+
+/* the process callback- block kernel per channel */
+static ftype b_dsp_run(unsigned frames, unsigned chans){
+	ftype r = 0;
+	for(unsigned c = 0; c < chans; c++)
+		r += dsp_run(&meter, &state[c], bufs + c * frames, frames, frame);
+	frame += frames;
+	return r;
+}
+
+/* same with true peak for peak and clip */
+static ftype b_dsp_run_tp(unsigned frames, unsigned chans){
+	meter.true_peak = true;
+	ftype r = b_dsp_run(frames, chans);
+	meter.true_peak = false;
+	return r;
+}
+
+/* same with K-weighted loudness blocks as well */
+static ftype b_dsp_run_loud(unsigned frames, unsigned chans){
+	meter.loud.en = true;
+	ftype r = b_dsp_run(frames, chans);
+	meter.loud.en = false;
+	return r;
+}
+
+/* same with the windowed level detector- 10ms and 1s windows should cost the same */
+static ftype b_dsp_run_win(unsigned frames, unsigned chans, unsigned ms){
+	win_init(&meter.win, fs * ms / 1000, 3, 0.001, 0.001);
+	ftype r = b_dsp_run(frames, chans);
+	meter.win.en = false;
+	return r;
+}
+
+static ftype b_dsp_run_win10(unsigned frames, unsigned chans){
+	return b_dsp_run_win(frames, chans, 10);
+}
+
+static ftype b_dsp_run_win1000(unsigned frames, unsigned chans){
+	return b_dsp_run_win(frames, chans, 1000);
+}
+
+/* the kernels on their own- sample peak comes out of the prep pass, true peak is extra */
+#define KERNEL_CHUNK 256
+
+static ftype b_prep(unsigned frames, unsigned chans){
+	float sq[KERNEL_CHUNK];
+	ftype r = 0;
+	for(unsigned c = 0; c < chans; c++)
+		for(unsigned i = 0; i < frames; i += KERNEL_CHUNK){
+			unsigned len = frames - i < KERNEL_CHUNK ? frames - i : KERNEL_CHUNK;
+			r += dsp_prep(bufs + c * frames + i, sq, len);
+		}
+	return r;
+}
+
+static ftype b_true_peak(unsigned frames, unsigned chans){
+	float tp[KERNEL_CHUNK];
+	ftype r = 0;
+	for(unsigned c = 0; c < chans; c++)
+		for(unsigned i = 0; i < frames; i += KERNEL_CHUNK){
+			unsigned len = frames - i < KERNEL_CHUNK ? frames - i : KERNEL_CHUNK;
+			r += dsp_true_peak(&state[c].tp, bufs + c * frames + i, tp, len);
+		}
+	return r;
+}
+
+/* level_gate output mid ramp, the worst case- open or closed its a copy or silence */
+static ftype b_gate_ramp(unsigned frames, unsigned chans){
+	struct gate g;
+	struct gate_state s = { .open = true, .g0 = 0.25, .g1 = 0.5 };
+	gate_init(&g, frames * 4, 0);
+	for(unsigned c = 0; c < chans; c++)
+		gate_apply(&g, &s, bufs + c * frames, outs + c * frames, frames);
+	return outs[frames - 1];
+}
+
+/* band analyser- the realtime thread only copies into the ring. Taken straight back out, so it never fills */
+static struct bands * bands10, * bands31;
+
+static ftype b_bands_put(unsigned frames, unsigned chans){
+	const float * in[BANDS_MAX_CHANNELS];
+	for(unsigned c = 0; c < chans && c < BANDS_MAX_CHANNELS; c++)
+		in[c] = bufs + c * frames;
+	bands_put(bands31, in, chans, frames);
+	atomic_store(&bands31->tail, atomic_load(&bands31->head));
+	atomic_store(&bands31->pos_tail, bands31->_pos);
+	return bands31->_pos;
+}
+
+/* the process callback with it- against dsp_run */
+static ftype b_dsp_run_bands(unsigned frames, unsigned chans){
+	ftype r = b_dsp_run(frames, chans);
+	return r + b_bands_put(frames, chans);
+}
+
+/* and the worker, per channel */
+static ftype b_bands_run(struct bands * b, unsigned frames, unsigned chans){
+	const float * in[BANDS_MAX_CHANNELS];
+	for(unsigned c = 0; c < chans && c < BANDS_MAX_CHANNELS; c++)
+		in[c] = bufs + c * frames;
+	bands_put(b, in, chans, frames);
+	return bands_run(b);
+}
+
+static ftype b_bands_run10(unsigned frames, unsigned chans){
+	return b_bands_run(bands10, frames, chans);
+}
+
+static ftype b_bands_run31(unsigned frames, unsigned chans){
+	return b_bands_run(bands31, frames, chans);
+}
+
+/* offload- all the process callback does is copy into the ring and post the worker. Taken straight back out */
+static struct offload * worker;
+
+static ftype b_offload_put(unsigned frames, unsigned chans){
+	const float * in[chans];
+	for(unsigned c = 0; c < chans; c++)
+		in[c] = bufs + c * frames;
+	offload_put(worker, NULL, frame, in, chans, frames);
+	frame += frames;
+	atomic_store(&worker->tail, atomic_load(&worker->head));
+	atomic_store(&worker->pos_tail, worker->_pos);
+	return worker->_pos;
+}
+
+static ftype offload_sum;
+
+static void offload_meters(void * arg, struct audio_bank * bank, uint64_t at, const float * x, unsigned n){
+	(void)bank; /* queued with none */
+	for(unsigned c = 0; c < *(unsigned *)arg; c++)
+		offload_sum += dsp_run(&meter, &state[c], x + c * n, n, at);
+}
+
+/* and the worker running dsp_run on the copies, both halves on one thread- against dsp_run */
+static ftype b_offload_run(unsigned frames, unsigned chans){
+	const float * in[chans];
+	for(unsigned c = 0; c < chans; c++)
+		in[c] = bufs + c * frames;
+	offload_put(worker, NULL, frame, in, chans, frames);
+	frame += frames;
+	offload_run(worker, offload_meters, &chans);
+	sem_trywait(&worker->wake);
+	return offload_sum;
+}
+
+/* fanout- dsp_run split across 1 (serial), 2 and 4 threads, this one and helpers. Threads over the cores only
+ * show what handing over costs */
+static struct fanout * fan2, * fan4;
+static unsigned fan_frames;
+
+static unsigned b_fanout_meters(void * arg, unsigned from, unsigned to){
+	(void)arg; /* the block is in the globals */
+	unsigned events = 0;
+	for(unsigned c = from; c < to; c++)
+		events += dsp_run(&meter, &state[c], bufs + c * fan_frames, fan_frames, frame);
+	return events;
+}
+
+static ftype b_fanout(struct fanout * f, unsigned frames, unsigned chans){
+	fan_frames = frames;
+	unsigned r = fanout_run(f, b_fanout_meters, NULL, chans);
+	frame += frames;
+	return r;
+}
+
+static ftype b_fanout1(unsigned frames, unsigned chans){
+	return b_fanout(NULL, frames, chans);
+}
+
+static ftype b_fanout2(unsigned frames, unsigned chans){
+	return b_fanout(fan2, frames, chans);
+}
+
+static ftype b_fanout4(unsigned frames, unsigned chans){
+	return b_fanout(fan4, frames, chans);
+}
+
+struct bench_case {
+	const char * name;
+	bench_fn fn;
+	bool chans; /* sweep channels too- otherwise single channel */
+};
+
+static const struct bench_case cases[] = {
+	{ "run_lowpass", b_run_lowpass, false },
+	{ "rms_run", b_rms_run, false },
+	{ "rms_run_full", b_rms_run_full, false },
+	{ "peak_run", b_peak_run, false },
+	{ "peak_run_nohold", b_peak_run_nohold, false },
+	{ "clip_run", b_clip_run, false },
+	{ "sample_loop", b_sample_loop, true },
+	{ "dsp_run", b_dsp_run, true },
+	{ "prep", b_prep, false },
+	{ "true_peak", b_true_peak, false },
+	{ "dsp_run_tp", b_dsp_run_tp, true },
+	{ "dsp_run_loud", b_dsp_run_loud, true },
+	{ "dsp_run_win10", b_dsp_run_win10, true },
+	{ "dsp_run_win1000", b_dsp_run_win1000, true },
+	{ "gate_ramp", b_gate_ramp, true },
+	{ "bands_put", b_bands_put, true },
+	{ "dsp_run_bands", b_dsp_run_bands, true },
+	{ "bands_run10", b_bands_run10, true },
+	{ "bands_run31", b_bands_run31, true },
+	{ "offload_put", b_offload_put, true },
+	{ "offload_run", b_offload_run, true },
+	{ "fanout1", b_fanout1, true },
+	{ "fanout2", b_fanout2, true },
+	{ "fanout4", b_fanout4, true },
+	{ NULL, NULL, false },
+};
+
+static volatile ftype sink;
+
+static void bench(const struct bench_case * bc, unsigned frames, unsigned chans){
+	/* warm up, then run until min_ms has passed */
+	sink += bc->fn(frames, chans);
+	uint64_t iters = 0;
+	uint64_t t0 = nsecs(), c0 = cycles(), t1;
+	do {
+		for(int i = 0; i < 16; i++)
+			sink += bc->fn(frames, chans);
+		iters += 16;
+	} while(((t1 = nsecs())) - t0 < min_ms * 1000000ULL);
+	uint64_t c1 = cycles();
+
+	double samples = (double)iters * frames * chans;
+	printf("%-16s %6u %6u %10.3f", bc->name, frames, chans, (t1 - t0) / samples);
+	if(c1 > c0)
+		printf(" %12.2f", (c1 - c0) / samples);
+	else
+		printf(" %12s", "-");
+	printf("\n");
+}
+
+/* comma separated list of numbers */
+static unsigned parse_list(char * arg, unsigned * list){
+	unsigned n = 0;
+	for(char * t = strtok(arg, ","); t && n < MAX_SWEEP; t = strtok(NULL, ","))
+		list[n++] = strtoul(t, NULL, 0);
+	return n;
+}
+
+static void printhelp(void){
+	printf("Help:\n"
+		"\t-h\tThis help\n"
+		"\t-b\tcomma separated block sizes in frames, default 16,32,...,4096\n"
+		"\t-c\tcomma separated channel counts, default 1,2,8,32,128\n"
+		"\t-m\tms to run each measurement, default 20\n"
+		"\t-f\tonly run cases containing this name\n"
+		"\t-r\tsample rate the meters are set up for, default 48000. The rms filter is decimated more at higher rates\n");
+	exit(0);
+}
+
+int main(int argc, char *argv[]){
+	int o;
+	while (((o = getopt(argc, argv, "hb:c:m:f:r:")) != -1)) {
+		switch (o) {
+		case 'b':
+			n_frames = parse_list(optarg, sweep_frames);
+			break;
+		case 'c':
+			n_chans = parse_list(optarg, sweep_chans);
+			break;
+		case 'm':
+			min_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			only = optarg;
+			break;
+		case 'r':
+			fs = strtod(optarg, NULL);
+			break;
+		default:
+			printhelp();
+			break;
+		}
+	}
+
+	unsigned max_frames = 0, max_chans = 0;
+	for(unsigned i = 0; i < n_frames; i++)
+		if(sweep_frames[i] > max_frames)
+			max_frames = sweep_frames[i];
+	for(unsigned i = 0; i < n_chans; i++)
+		if(sweep_chans[i] > max_chans)
+			max_chans = sweep_chans[i];
+	if(!max_frames || !max_chans)
+		printhelp();
+
+	/* -6dB sine per channel, different frequency per channel, with a short clipped burst */
+	bufs = aligned_calloc((size_t)max_frames * max_chans, sizeof(float));
+	outs = aligned_calloc((size_t)max_frames * max_chans, sizeof(float));
+	state = aligned_calloc(max_chans, sizeof(struct meter_state));
+	if(!bufs || !outs || !state)
+		return 1;
+	for(unsigned c = 0; c < max_chans; c++)
+		for(unsigned i = 0; i < max_frames; i++)
+			bufs[c * max_frames + i] = i < 8 ? 1.0f : 0.5f * sinf(2.0 * M_PI * (100.0 + 50.0 * c) * i / fs);
+
+	dsp_init();
+	rms_init(&meter.rms, fs, 0);
+	rms_init(&rms_full, fs, 1);
+	peak_init(&meter.peak, fpow(10.0, -65.0/20.0), fs * 800 / 1000, fs * 800 / 1000); /* jackmon defaults */
+	clip_init(&meter.clip, 4);
+	loud_init(&meter.loud, fs);
+	meter.loud.en = false; /* dsp_run_loud turns it on */
+	if(!((bands10 = bands_init(10, fs, fs / 20))) || !((bands31 = bands_init(31, fs, fs / 20))) ||
+			!((worker = offload_init(fs / 50))) || !((fan2 = fanout_init(1, 0, 0))) || !((fan4 = fanout_init(3, 0, 0))))
+		return 1;
+	cycles_init();
+
+	printf("# ftype %s, isa %s, cycles from %s, rate %0.0f, rms decimate %u, %ld cpus\n", FTYPE_NAME, dsp_isa, cycle_src, fs,
+			meter.rms.decimate, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("%-16s %6s %6s %10s %12s\n", "case", "frames", "chans", "ns/sample", "cycles/sample");
+	for(const struct bench_case * bc = cases; bc->name; bc++){
+		if(only && !strstr(bc->name, only))
+			continue;
+		for(unsigned c = 0; c < (bc->chans ? n_chans : 1); c++)
+			for(unsigned f = 0; f < n_frames; f++)
+				bench(bc, sweep_frames[f], bc->chans ? sweep_chans[c] : 1);
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * bench_layout.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Channel bank layout benchmark- the meters over 256 frame blocks at 2, 8, 32 and 128 channels, with the channel
+ * state laid out as struct chan was before the split, and as the bank is now. Each runs alone, then with a thread
+ * polling the snapshots as the main loop does. Only the cpu time of the metering thread is counted.
+ */
+
+#define _GNU_SOURCE
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+
+#include "utils.h"
+#include "dsp.h"
+
+#define FRAMES 256
+#define MAX_CHANS 128
+#define RUN_MS 300 /* each measurement */
+
+static const unsigned sweep_chans[] = { 2, 8, 32, 128 };
+
+/* snapshot and main loop copy, as in audio.h */
+struct snap_vals {
+	ftype rms;
+	ftype peak;
+	unsigned clips;
+	unsigned events;
+};
+
+struct chan_vals {
+	ftype rms_val;
+	ftype peak_val;
+	bool clip_event;
+	unsigned _clips;
+};
+
+/* before- everything for a channel in one element: its own copy of the config, the realtime state, the snapshot
+ * and the main loop copy */
+struct old_chan {
+	struct meter meter;
+	struct meter_state state;
+	atomic_uint seq;
+	struct snap_vals snap;
+	struct chan_vals chan;
+};
+
+/* after- shared config, and each array on its own lines */
+struct new_snap {
+	_Alignas(CACHELINE) atomic_uint seq;
+	struct snap_vals snap;
+};
+
+static struct old_chan * old;
+static struct meter meter;
+static struct meter_state * state;
+static struct new_snap * snap;
+static struct chan_vals * chan;
+static float * bufs;
+static uint64_t frame; /* sample clock, advanced every cycle */
+
+static atomic_bool polling, stop;
+static atomic_bool use_old;
+static atomic_uint n_chans;
+
+static void publish(struct meter_state * m, atomic_uint * seq, struct snap_vals * s){
+	seq_write_begin(seq);
+	s->rms = rms_get(&m->rms);
+	peak_get(&m->peak, &s->peak);
+	s->clips += clip_get(&m->clip);
+	s->events += m->pending;
+	seq_write_end(seq);
+	m->pending = 0;
+}
+
+static void poll_chan(atomic_uint * seq, const struct snap_vals * s, struct chan_vals * c){
+	unsigned n, clips;
+	do {
+		n = seq_read_begin(seq);
+		c->rms_val = s->rms;
+		c->peak_val = s->peak;
+		clips = s->clips;
+	} while(seq_read_retry(seq, n));
+	c->clip_event |= clips != c->_clips;
+	c->_clips = clips;
+}
+
+/* the main loop- poll every channel over and over */
+static void * poller(void * arg){
+	(void)arg;
+	while(!atomic_load(&stop)){
+		if(!atomic_load(&polling)){
+			millisleep(1);
+			continue;
+		}
+		unsigned n = atomic_load(&n_chans);
+		for(unsigned i = 0; i < n; i++)
+			if(atomic_load_explicit(&use_old, memory_order_relaxed))
+				poll_chan(&old[i].seq, &old[i].snap, &old[i].chan);
+			else
+				poll_chan(&snap[i].seq, &snap[i].snap, &chan[i]);
+	}
+	return NULL;
+}
+
+static void cycle(bool before, unsigned chans){
+	for(unsigned i = 0; i < chans; i++){
+		const float * x = bufs + i * FRAMES;
+		if(before){
+			old[i].state.pending += dsp_run(&old[i].meter, &old[i].state, x, FRAMES, frame);
+			publish(&old[i].state, &old[i].seq, &old[i].snap);
+		} else {
+			state[i].pending += dsp_run(&meter, &state[i], x, FRAMES, frame);
+			publish(&state[i], &snap[i].seq, &snap[i].snap);
+		}
+	}
+	frame += FRAMES;
+}
+
+static uint64_t cpu_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ns per sample per channel */
+static double bench(bool before, unsigned chans){
+	struct timespec end;
+	uint64_t cycles = 0, t0;
+	atomic_store(&use_old, before);
+	atomic_store(&n_chans, chans);
+	for(unsigned k = 0; k < 16; k++) /* warm up */
+		cycle(before, chans);
+	t0 = cpu_ns();
+	set_timer(&end, RUN_MS);
+	while(timer_poll(&end)){
+		for(unsigned k = 0; k < 16; k++)
+			cycle(before, chans);
+		cycles += 16;
+	}
+	return (double)(cpu_ns() - t0) / ((double)cycles * FRAMES * chans);
+}
+
+int main(void){
+	pthread_t t;
+	dsp_init();
+	old = aligned_calloc(MAX_CHANS, sizeof(struct old_chan));
+	state = aligned_calloc(MAX_CHANS, sizeof(struct meter_state));
+	snap = aligned_calloc(MAX_CHANS, sizeof(struct new_snap));
+	chan = calloc(MAX_CHANS, sizeof(struct chan_vals));
+	bufs = aligned_calloc(MAX_CHANS * FRAMES, sizeof(float));
+	if(!old || !state || !snap || !chan || !bufs){
+		perror("bench_layout");
+		return 1;
+	}
+
+	/* the same meters as jackmon runs by default */
+	rms_init(&meter.rms, 48000.0, 0);
+	peak_init(&meter.peak, fpow(10.0, -65.0/20.0), 38400, 38400);
+	clip_init(&meter.clip, 4);
+	for(unsigned i = 0; i < MAX_CHANS; i++)
+		old[i].meter = meter;
+	uint32_t r = 1;
+	for(unsigned i = 0; i < MAX_CHANS * FRAMES; i++){
+		r = r * 1664525 + 1013904223;
+		bufs[i] = 0.1f * sinf(i * 0.05f) + (float)(int32_t)r * 0x1p-36f;
+	}
+
+	if(pthread_create(&t, NULL, poller, NULL)){
+		perror("poller");
+		return 1;
+	}
+	printf("# channel bank layout, ns/sample/channel on the metering thread, %u frame blocks, %s\n", FRAMES, dsp_isa);
+	printf("%-24s", "channels");
+	for(unsigned c = 0; c < sizeof(sweep_chans) / sizeof(sweep_chans[0]); c++)
+		printf("%8u", sweep_chans[c]);
+	printf("\n");
+	for(unsigned p = 0; p < 2; p++){
+		atomic_store(&polling, p);
+		for(int before = 1; before >= 0; before--){
+			printf("%-24s", before ? (p ? "old layout, polled" : "old layout") : (p ? "new layout, polled" : "new layout"));
+			for(unsigned c = 0; c < sizeof(sweep_chans) / sizeof(sweep_chans[0]); c++)
+				printf("%8.2f", bench(before, sweep_chans[c]));
+			printf("\n");
+		}
+	}
+	atomic_store(&stop, true);
+	pthread_join(t, NULL);
+	return 0;
+}
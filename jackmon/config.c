@@ -0,0 +1,434 @@
+/*
+ * config.c
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <glob.h>
+#include <libgen.h>
+
+#include "audio.h"
+#include "config.h"
+#include "host.h"
+
+static void printhelp(const struct config_ext * ext);
+static bool parseflag(char * val);
+
+/* specify actions
+ * -d debug
+ * -s source connection regex- finds matching source channels and connects to these
+ * -n name of this instance as a jack service
+ * -D host mode- run every *.conf in this directory in one jack client, eg /etc/jackmon.d
+ * -p name of pipe/file to stream {rms peak} pairs in dB, space separated, newline per poll event: use for VU meter
+ * -c script to run if we clip- clip detection only enabled in debug mode, or if this script is specified
+ *		eg user this to set an LED or write something to a LCD front end.
+ * -l threshold in dBfs where if RMS level exceeds this, we consider the source ON
+ * -h hold time for threshold detection in ms
+ * -E script to run when threshold exceeded, set environment variable LEVEL to 1 or 0
+ * -e sink connection regex to map sequentially when threshold is exceeded. disconnect after hold time
+ *
+ * rms is calculated if -p, and/or -l and -h and -E/-e are specified
+ * clip is calculated if debug mode, or -C is specified- this can be a one-shot LED for example.
+ * peak is calculated if -p is specified
+ */
+static void parse_opts(struct audio * audio, int argc, char *argv[], const struct config_ext * ext){
+	char optstring[64] = "hdNvs:e:c:C:G:g:n:f:D:t:l:E:p:P:";
+	if(ext && ext->opts)
+		strncat(optstring, ext->opts, sizeof(optstring) - strlen(optstring) - 1);
+
+	int o;
+	optind = 1;
+	while (((o = getopt(argc, argv, optstring)) != -1)) {
+		switch (o) {
+		case 'h':
+			printhelp(ext);
+			break;
+		case 'd':
+			audio->debug = true;
+			break;
+		case 'N':
+			audio->noreconnect = true;
+			break;
+		case 'v':
+			audio->vu_pretty = true;
+			break;
+		case 's':
+			audio->sources=optarg;
+			break;
+		case 'e':
+			audio->level_sinks=optarg;
+			break;
+		case 'C':
+			audio->clip_cmd=optarg;
+			break;
+		case 'c':
+			audio->clip_ms=strtoul(optarg, NULL, 0);
+			break;
+		case 'G':
+			audio->clip_gpio.gpio=strtol(optarg, NULL, 0);
+			break;
+		case 'n':
+			audio->name=optarg;
+			break;
+		case 'f':
+			audio->config=optarg;
+			break;
+		case 'D':
+			audio->config_dir=optarg;
+			break;
+		case 't':
+			audio->level_sec=strtoul(optarg, NULL, 0)*1000; /* seconds to ms */
+			break;
+		case 'l':
+			audio->level_thres=fpow(10.0, strtof(optarg, NULL)/20); /* dB to level- should be negative of course */
+			break;
+		case 'E':
+			audio->level_cmd=optarg;
+			break;
+		case 'g':
+			audio->level_gpio.gpio=strtol(optarg, NULL, 0);
+			break;
+		case 'p':
+			audio->vu_pipe=optarg;
+			break;
+		case 'P':
+			audio->vu_ms=strtoul(optarg, NULL, 0);
+			break;
+		default:
+			if(!ext || !ext->opt || ext->opt(o, optarg))
+				printhelp(ext);
+			break;
+		}
+	}
+}
+
+static bool parseflag(char * val){
+	return !strcasecmp(val, "true") || !strcmp(val, "1");
+}
+
+/* parse audio->config file */
+static void config_read(struct audio * audio){
+	/* try to open config file and parse it */
+    FILE *fp = fopen(audio->config, "r");
+    if (!fp){
+    	fprintf(stderr, "ERROR: Can't read config file %s\n", audio->config);
+    	exit(2); /* code to tell systemd to not try to restart */
+    }
+
+    debug(audio, "reading config file %s\n", audio->config);
+
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+    	char *s = line;
+    	while (isspace((unsigned char)*s))
+    		s++;
+        if (*s == '#' || *s == '\n' || *s == '\0')
+        	continue;
+
+        char *_key = strtok(s, "=");
+        char *val = strtok(NULL, "\n");
+        if (!_key || !val)
+        	continue;
+        char * key = strdup(_key);
+        if (!key)
+        	continue;
+
+        while (isspace((unsigned char)*(key + strlen(key)-1)))
+        	*(key + strlen(key)-1) = 0;
+
+        /* Trim leading whitespace from value */
+        while (isspace((unsigned char)*val))
+        	val++;
+
+        if (!strcmp(key, "debug"))
+        	audio->debug = parseflag(val);
+        else if (!strcmp(key, "server")){
+        	Asprintf(&audio->server, "%s", val);
+        } else if (!strcmp(key, "name")){
+        	Asprintf(&audio->name, "%s", val);
+        }else if (!strcmp(key, "noreconnect"))
+        	audio->noreconnect = parseflag(val); /* override noreconnect not set on command line */
+        else if (!strcmp(key, "sources")) {
+        	Asprintf(&audio->sources, "%s", val);
+        } else if (!strcmp(key, "level_sinks")) {
+        	Asprintf(&audio->level_sinks, "%s", val);
+        } else if (!strcmp(key, "level_thres")){
+        	float l;
+        	sscanf(val, "%f", &l);
+        	audio->level_thres = fpow(10.0, l/20);
+        } else if (!strcmp(key, "level_release")){
+        	float l;
+        	sscanf(val, "%f", &l);
+        	audio->level_release = fpow(10.0, l/20);
+        } else if (!strcmp(key, "level_cmd")){
+        	Asprintf(&audio->level_cmd, "%s", val);
+        } else if (!strcmp(key, "level_sec"))
+        	audio->level_sec = strtoul(val, NULL, 0);
+		else if (!strcmp(key, "level_window_ms"))
+			audio->level_window_ms = strtoul(val, NULL, 0);
+		else if (!strcmp(key, "level_windows"))
+			audio->level_windows = strtoul(val, NULL, 0);
+		else if (!strcmp(key, "level_gpio"))
+			audio->level_gpio.gpio = strtol(val, NULL, 0);
+		else if (!strcmp(key, "level_gate"))
+			audio->level_gate = parseflag(val);
+		else if (!strcmp(key, "level_gate_ms"))
+			audio->level_gate_ms = strtoul(val, NULL, 0);
+        else if (!strcmp(key, "clip_cmd")){
+			Asprintf(&audio->clip_cmd, "%s", val);
+        }else if (!strcmp(key, "clip_ms"))
+			audio->clip_ms = strtoul(val, NULL, 0);
+        else if (!strcmp(key, "clip_samples"))
+        	audio->clip_samples = strtoul(val, NULL, 0);
+        else if (!strcmp(key, "clip_gpio"))
+			audio->clip_gpio.gpio = strtol(val, NULL, 0);
+        else if (!strcmp(key, "gpio_root")){
+			Asprintf(&audio->gpio_root, "%s", val);
+        } else if (!strcmp(key, "gpio_chip")){
+			Asprintf(&audio->gpio_chip, "%s", val);
+        }
+		else if (!strcmp(key, "profile"))
+			audio->profile = strtoul(val, NULL, 0);
+		else if (!strcmp(key, "offload"))
+			audio->offload = parseflag(val);
+		else if (!strcmp(key, "offload_ms"))
+			audio->offload_ms = strtoul(val, NULL, 0);
+		else if (!strcmp(key, "offload_priority"))
+			audio->offload_priority = strtol(val, NULL, 0);
+		else if (!strcmp(key, "fanout"))
+			audio->fanout = strtoul(val, NULL, 0);
+		else if (!strcmp(key, "fanout_min"))
+			audio->fanout_min = strtoul(val, NULL, 0);
+		else if (!strcmp(key, "offload_cpu")){ /* eg 3, or 2,3 */
+			char * p = val;
+			do
+				audio->offload_cpus |= 1UL << (strtoul(p, &p, 0) % (8 * sizeof(unsigned long)));
+			while(*p++ == ',');
+		}
+		else if (!strcmp(key, "vu_ms"))
+			audio->vu_ms = strtoul(val, NULL, 0);
+		else if (!strcmp(key, "vu_peak_hold_ms"))
+			audio->vu_peak_hold_ms = strtoul(val, NULL, 0);
+		else if (!strcmp(key, "vu_pipe")){
+		    Asprintf(&audio->vu_pipe, "%s", val);
+		} else if (!strcmp(key, "vu_shm")){
+		    Asprintf(&audio->vu_shm, "%s", val);
+		} else if (!strcmp(key, "true_peak"))
+			audio->true_peak = parseflag(val);
+		else if (!strcmp(key, "loudness"))
+			audio->loudness = parseflag(val);
+		else if (!strcmp(key, "bands")){
+			audio->bands = strtoul(val, NULL, 0);
+			if(audio->bands && audio->bands != 10 && audio->bands != 31){
+				fprintf(stderr, "bands = %s- use 10 or 31. No band analyser\n", val);
+				audio->bands = 0;
+			}
+		}
+		else if (!strcmp(key, "vu_pretty"))
+        	audio->vu_pretty = parseflag(val);
+		else if (!strcmp(key, "vu_format")){
+			if(!strcmp(val, "float"))
+				audio->vu_format = VU_FORMAT_FLOAT;
+			else if(!strcmp(val, "cdb"))
+				audio->vu_format = VU_FORMAT_CDB;
+			else if(strcmp(val, "text"))
+				fprintf(stderr, "Unknown vu_format %s- using text\n", val);
+		}
+        free(key);
+    }
+    fclose(fp);
+}
+
+void config_parse(struct audio * audio, int argc, char *argv[], const struct config_ext * ext){
+	parse_opts(audio, argc, argv, ext);
+
+	if(!audio->config){ /* no file specified in command line - try default locations */
+		if(audio->name){ /* client name specified in commandd line */
+			Asprintf(&audio->config, "/etc/jackmon.d/%s.conf", audio->name);
+		} else
+			audio->config = "/etc/jackmon.conf"; /* default unnamed */
+	}
+
+	config_read(audio);
+	parse_opts(audio, argc, argv, ext); /* command line options take priority so override */
+	if(!audio->name) /* default if not specified on command line or in config file */
+		audio->name = "jackmon";
+}
+
+/* host mode- a context per *.conf in dir, named after the file unless the file sets a name.
+ * Command line options apply to all of them, except -n which names the jack client */
+static void config_parse_dir(struct host * host, const char * dir, int argc, char *argv[], const struct config_ext * ext){
+	glob_t g;
+	char * pattern;
+	Asprintf(&pattern, "%s/*.conf", dir);
+	int ret = glob(pattern, 0, NULL, &g);
+	free(pattern);
+	if(ret || !g.gl_pathc){
+		fprintf(stderr, "ERROR: No config files in %s\n", dir);
+		exit(2);
+	}
+
+	if(!((host->ctx = calloc(g.gl_pathc, sizeof(struct host_ctx *)))))
+		exit(1);
+	for(size_t i = 0; i < g.gl_pathc; i++){
+		struct host_ctx * ctx;
+		if(!((ctx = calloc(1, sizeof(struct host_ctx)))))
+			exit(1);
+		struct audio * audio = &ctx->audio;
+		parse_opts(audio, argc, argv, ext); /* for debug */
+		audio->config = strdup(g.gl_pathv[i]);
+		Asprintf(&audio->name, "%s", basename(g.gl_pathv[i]));
+		*strrchr(audio->name, '.') = 0;
+		config_read(audio);
+
+		char * name = audio->name;
+		parse_opts(audio, argc, argv, ext); /* command line options take priority so override */
+		audio->name = name;
+
+		if(config_defaults(audio)){
+			fprintf(stderr, "Skipping %s\n", audio->config);
+			free(ctx);
+			continue;
+		}
+		if(audio->server && !host->server)
+			host->server = audio->server;
+		else if(audio->server && strcmp(audio->server, host->server))
+			fprintf(stderr, "%s: all contexts run on server %s\n", audio->config, host->server);
+		host->ctx[host->n++] = ctx;
+	}
+	globfree(&g);
+}
+
+/* load every context to host- each *.conf in the -D directory, or just the one config file.
+ * return 2 if nothing is configured, or config_defaults() error for the one file. Directory ones with errors are skipped */
+int config_load(struct host * host, int argc, char *argv[], const struct config_ext * ext){
+	struct audio opts = {0};
+	parse_opts(&opts, argc, argv, ext);
+
+	if(opts.config_dir){
+		config_parse_dir(host, opts.config_dir, argc, argv, ext);
+		host->name = opts.name ?: "jackmon";
+		return host->n ? 0 : 2;
+	}
+
+	struct host_ctx * ctx;
+	if(!((ctx = calloc(1, sizeof(struct host_ctx)))) || !((host->ctx = calloc(1, sizeof(struct host_ctx *)))))
+		exit(1);
+	config_parse(&ctx->audio, argc, argv, ext);
+	int err;
+	if((err = config_defaults(&ctx->audio)))
+		return err;
+	host->ctx[host->n++] = ctx;
+	host->name = ctx->audio.name; /* the client is named after the context */
+	host->server = ctx->audio.server;
+	return 0;
+}
+
+/* fill in defaults and work out which functions are enabled from the config.
+ * return 2 if nothing is configured, 1 if it asks for functions that can't run together */
+int config_defaults(struct audio * audio){
+	/* set defaults- analog input port capture for host... in pipewire naming convention */
+	if(!audio->sources)
+		audio->sources = "Built-in Audio.*:capture_*";
+
+	/* setup GPIO */
+	audio->level_gpio.root = audio->clip_gpio.root = audio->gpio_root;
+	audio->level_gpio.chip = audio->clip_gpio.chip = audio->gpio_chip;
+	if(audio->level_gpio.gpio)
+		audio->level_gpio.name = "Level";
+
+	/* Set up "vox" to do something when level exceeds threshold */
+	if(audio->level_sinks || audio->level_cmd || audio->level_gpio.gpio || audio->level_gate){
+		/* lets set up some defaults for RMS detection */
+		audio->rms_en = true; /* level needs rms */
+		if(!audio->level_sec)
+			audio->level_sec = 60; /* 1 minute hold */
+		if(!audio->level_thres)
+			audio->level_thres = fpow(10.0, -65.0/20.0); /* -65dB to trigger */
+		if(!audio->level_release)
+			audio->level_release = audio->level_thres; /* no hysteresis */
+		else if(audio->level_release > audio->level_thres){
+			fprintf(stderr, "level_release is above level_thres- using level_thres\n");
+			audio->level_release = audio->level_thres;
+		}
+		if(audio->level_window_ms && !audio->level_windows)
+			audio->level_windows = 1;
+		if(audio->level_gate && !audio->level_gate_ms)
+			audio->level_gate_ms = 10; /* ramp- short enough to keep the start, long enough not to click */
+	} else
+		audio->level_sec = 0; /* use zero timeout to flag we don't use the trigger/hold feature */
+
+	if(audio->offload && audio->level_gate){
+		fprintf(stderr, "ERROR: level_gate gates the output in the process callback- it can't be offloaded\n");
+		return 1;
+	}
+	if(audio->fanout && !audio->fanout_min)
+		audio->fanout_min = 32; /* waking the helpers costs about what their share of fewer channels saves */
+	if(audio->offload && !audio->offload_ms)
+		audio->offload_ms = 20; /* a few cycles of slack at any period size, and under what anyone would see */
+
+	/* VU meterage - uses RMS and peak */
+	if(audio->vu_format && !audio->vu_pipe){
+		fprintf(stderr, "vu_format needs vu_pipe- stdout has events on it. Using text\n");
+		audio->vu_format = VU_FORMAT_TEXT;
+	}
+	if(audio->vu_format)
+		audio->vu_pretty = false; /* binary stream- not for a console */
+	if((audio->vu_pipe || audio->vu_pretty || audio->bands) && !audio->vu_ms)
+		audio->vu_ms = 50; /* 50ms update rate by default */
+
+	if(audio->vu_ms || audio->vu_shm){
+		if(!audio->vu_peak_hold_ms)
+			audio->vu_peak_hold_ms = 800; /* peak hold for 800ms */
+		audio->rms_en = true; /* vu needs rms and peak */
+	}
+
+	/* Handle clipping */
+	if(audio->clip_cmd || audio->debug || audio->clip_gpio.gpio){
+		audio->clip_en = true;
+		if(!audio->clip_samples)
+			audio->clip_samples = 4;
+		if(audio->clip_gpio.gpio){
+			if(!audio->clip_ms)
+				audio->clip_ms = 200; /* default 200ms for LED flash */
+			if(audio->clip_gpio.gpio)
+				audio->clip_gpio.name = "Clip Indicator";
+		}
+	}
+
+	if(!audio->rms_en && !audio->clip_en && !audio->loudness) {
+		fprintf(stderr, "Empty Configuration- no actions configured\n");
+		return 2;
+	}
+	return 0;
+}
+
+static void printhelp(const struct config_ext * ext) {
+	printf("Help:\n"
+		"\t-h\tThis help\n"
+		"\t-s\tsource connection regex- finds matching source channels and connects to these\n"
+		"\t-n\tname of this instance as a jack service\n"
+		"\t-f\tconfig file- default is /etc/jackmon.conf if no name set, otherwise /etc/jackmon.d/<instance>.conf\n"
+		"\t-D\trun every *.conf in this directory in one jack client, eg /etc/jackmon.d. -n names the client\n"
+		"\t-p\tname of pipe/file to stream {rms peak} pairs in dB, space separated, newline per poll event: use for VU meter\n"
+		"\t-P\tupdate rate of rms values in ms- if set without -p, this will dump to stdout\n"
+		"\t-C\tscript to run if we clip- clip detection only enabled in debug mode, or if this script is specified\n"
+		"\t-G\tCLIP GPIO to drive LED. Negative number for active low\n"
+		"\t-c\tms to call script when clip over like a one-shot, with CLIP env 1 and 0 of this instance as a jack service\n"
+		"\t\t\teg user this to set an LED or write something to a LCD front end.\n"
+		"\t-l\tthreshold in dBfs where if RMS level exceeds this, we consider the source ON\n"
+		"\t-t\thold time for threshold detection in seconds\n"
+		"\t-g\tGPIO to dive relay when threshold reached, negative number for active low\n"
+		"\t-E\tscript to run when threshold exceeded, set environment variable TRIG to 1 or 0. Runs in the background, killed after 500ms\n"
+		"\t-e\tsink connection regex to map sequentially when threshold is exceeded. disconnect after hold time\n"
+		"\t-N\tDon't try to reconnect if source port connection gets removed\n");
+	if(ext && ext->help)
+		printf("%s", ext->help);
+	exit(0);
+}
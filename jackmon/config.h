@@ -0,0 +1,25 @@
+/*
+ * config.h
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include "audio.h"
+
+/* extra command line options for a tool built on the jackmon config */
+struct config_ext {
+	const char * opts; /* getopt string appended to the jackmon options */
+	const char * help; /* appended to help */
+	int (*opt)(int o, char * arg); /* handle option, return non-zero if unknown */
+};
+
+void config_parse(struct audio * audio, int argc, char *argv[], const struct config_ext * ext);
+int config_defaults(struct audio * audio);
+
+struct host;
+int config_load(struct host * host, int argc, char *argv[], const struct config_ext * ext);
+
+#endif /* CONFIG_H_ */
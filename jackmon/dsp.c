@@ -0,0 +1,680 @@
+/*
+ * dsp.c
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__arm__) && __GNUC__ >= 8
+/* armhf is built for vfp- only use NEON if the cpu has it (not a pi0) */
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#pragma GCC push_options
+#pragma GCC target("fpu=neon")
+#include <arm_neon.h>
+#pragma GCC pop_options
+#define DSP_ARM_NEON
+#endif
+
+#include "dsp.h"
+
+/* samples per block kernel pass- sized for the stack */
+#define DSP_CHUNK 256
+
+/* ITU-R BS.1770-4 annex 2 interpolator, y[phase] = sum h[phase][k] * x[n - k] */
+static const float tp_coef[4][TP_TAPS] = {
+	{ 0.0017089843750, 0.0109863281250, -0.0196533203125, 0.0332031250000, -0.0594482421875, 0.1373291015625,
+		0.9721679687500, -0.1022949218750, 0.0476074218750, -0.0266113281250, 0.0148925781250, -0.0083007812500 },
+	{ -0.0291748046875, 0.0292968750000, -0.0517578125000, 0.0891113281250, -0.1665039062500, 0.4650878906250,
+		0.7797851562500, -0.2003173828125, 0.1015625000000, -0.0582275390625, 0.0330810546875, -0.0189208984375 },
+	{ -0.0189208984375, 0.0330810546875, -0.0582275390625, 0.1015625000000, -0.2003173828125, 0.7797851562500,
+		0.4650878906250, -0.1665039062500, 0.0891113281250, -0.0517578125000, 0.0292968750000, -0.0291748046875 },
+	{ -0.0083007812500, 0.0148925781250, -0.0266113281250, 0.0476074218750, -0.1022949218750, 0.9721679687500,
+		0.1373291015625, -0.0594482421875, 0.0332031250000, -0.0196533203125, 0.0109863281250, 0.0017089843750 },
+};
+
+/* Compute 2nd order Butterworth low-pass coefficients, in delta form (see struct lowpass)
+ * fc = cutoff frequency (Hz)
+ * fs = sample rate (Hz)
+*/
+void init_lowpass(double fc, double fs, struct lowpass * f)
+{
+    double omega = 2.0 * M_PI * fc / fs; /* Pre-warp cutoff frequency to normalized rad/s */
+    double sin_half = sin(omega * 0.5); /* 1 - cos(omega) = 2 sin^2(omega/2), without the cancellation */
+    double alpha = sin(omega) / (2.0 * M_SQRT1_2); /* Butterworth (Q = 1/sqrt(2)) */
+    double s = 1.0 / (1.0 + alpha); /* normalise for a0 = 1 */
+    f->b = (ftype)(s * sin_half * sin_half); /* s * (1 - cos) / 2 */
+    f->c = (ftype)(s * 4.0 * sin_half * sin_half); /* 1 + a1 + a2, a1 = -2s cos, a2 = s (1 - alpha) */
+    f->e = (ftype)(s * 2.0 * alpha); /* 1 - a2 */
+}
+
+/* can be reinitialised. decimate 0 picks the largest power of 2 that keeps the filter at RMS_RATE_MIN or over-
+ * the sub-block mean is a boxcar with nulls on every multiple of the filter rate, so nothing aliases onto DC */
+void rms_init(struct rms * rms, double samplerate, unsigned decimate){
+	if(!decimate)
+		for(decimate = 1; samplerate / (decimate * 2) >= RMS_RATE_MIN; decimate *= 2)
+			;
+	rms->en = true;
+	rms->thres_sq = INFINITY;
+	rms->rel_sq = 0.0;
+	rms->decimate = decimate;
+	rms->_scale = 1.0 / decimate;
+	double fc = 6.0; /* -3dB at 6Hz emulates mechanical meter smoothing */
+	init_lowpass(fc, samplerate / decimate, &rms->f);
+}
+
+/* K-weighting for any samplerate, from the analogue prototypes of the BS.1770 48k filters */
+void loud_init(struct loud * loud, double samplerate){
+	/* stage 1- +4dB high shelf modelling the head */
+	double f0 = 1681.974450955533, G = 3.999843853973347, Q = 0.7071752369554196;
+	double K = tan(M_PI * f0 / samplerate);
+	double Vh = pow(10.0, G / 20.0), Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1.0 + K / Q + K * K;
+	loud->shelf.b0 = (ftype)((Vh + Vb * K / Q + K * K) / a0);
+	loud->shelf.b1 = (ftype)(2.0 * (K * K - Vh) / a0);
+	loud->shelf.b2 = (ftype)((Vh - Vb * K / Q + K * K) / a0);
+	loud->shelf.a1 = (ftype)(2.0 * (K * K - 1.0) / a0);
+	loud->shelf.a2 = (ftype)((1.0 - K / Q + K * K) / a0);
+	/* stage 2- RLB high pass at 38Hz */
+	f0 = 38.13547087602444;
+	Q = 0.5003270373238773;
+	K = tan(M_PI * f0 / samplerate);
+	a0 = 1.0 + K / Q + K * K;
+	loud->hpf.b0 = loud->hpf.b2 = 1.0;
+	loud->hpf.b1 = -2.0;
+	loud->hpf.a1 = (ftype)(2.0 * (K * K - 1.0) / a0);
+	loud->hpf.a2 = (ftype)((1.0 - K / Q + K * K) / a0);
+	loud->block = lrint(samplerate / 10.0);
+	loud->en = true;
+}
+
+/* window of samples, rounded to a multiple of WIN_SEGS. thres is on the mean square */
+void win_init(struct win * win, unsigned samples, unsigned n, ftype thres, ftype release){
+	win->seg = samples / WIN_SEGS ?: 1;
+	win->n = n ?: 1;
+	win->_scale = 1.0 / (win->seg * WIN_SEGS);
+	win->thres = thres * win->seg * WIN_SEGS;
+	win->release = release * win->seg * WIN_SEGS;
+	win->en = true;
+}
+
+void peak_init(struct peak * peak, ftype atten, unsigned decay_samples, unsigned hold_samples){
+	peak->hold_samples = hold_samples;
+	peak->decay_samples = decay_samples;
+	peak->_decay = fpow(atten, 1.0/(ftype)decay_samples);
+}
+
+void clip_init(struct clip * clip, unsigned threshold) {
+	clip->threshold = threshold;
+}
+
+/* ramp samples from closed to open */
+void gate_init(struct gate * g, unsigned ramp, uint64_t hold){
+	g->step = 1.0 / (ramp ?: 1);
+	g->hold = hold;
+	g->en = true;
+}
+
+/* the ramp for a block of n samples at sample clock frame, from the level detectors of every channel after their
+ * dsp_run(): on if any ended the block on, onset the first onset offset and release the last release, -1 for none.
+ * An onset opens it on that sample. It closes hold samples after the release that left none on, unless another onset
+ * comes first. Then gate_apply() each channel */
+void gate_run(const struct gate * g, struct gate_state * s, bool on, int onset, int release, uint64_t frame, unsigned n){
+	s->g0 = s->g1;
+	s->at = 0;
+	if(on || onset >= 0){
+		if(!s->open){
+			s->open = true;
+			s->at = onset >= 0 ? onset : 0;
+		}
+		s->close_at = on ? 0 : frame + (release >= 0 ? (unsigned)release : n) + g->hold; /* on and off in this block */
+	} else if(s->open && !s->close_at)
+		s->close_at = frame + (release >= 0 ? release : 0) + g->hold;
+	if(s->open && s->close_at && s->close_at < frame + n){
+		s->open = false;
+		s->at = s->close_at > frame ? s->close_at - frame : 0;
+		s->close_at = 0;
+	}
+	ftype d = s->open ? g->step : -g->step, g1 = s->g0 + d * (n - s->at);
+	s->g1 = g1 < 0.0 ? 0.0 : g1 > 1.0 ? 1.0 : g1;
+}
+
+/* portable fallback */
+static float prep_c(const float * x, float * sq, unsigned n){
+	float m = 0.0f;
+	for(unsigned i = 0; i < n; i++){
+		float a = fabsf(x[i]);
+		if(a > m)
+			m = a;
+		sq[i] = x[i] * x[i];
+	}
+	return m;
+}
+
+#if defined(__x86_64__)
+static float prep_sse(const float * x, float * sq, unsigned n){
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 m = _mm_setzero_ps();
+	unsigned i = 0;
+	for(; i + 4 <= n; i += 4){
+		__m128 v = _mm_loadu_ps(x + i);
+		m = _mm_max_ps(m, _mm_and_ps(v, mask));
+		_mm_storeu_ps(sq + i, _mm_mul_ps(v, v));
+	}
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	float r = _mm_cvtss_f32(m);
+	float t = prep_c(x + i, sq + i, n - i);
+	return t > r ? t : r;
+}
+
+__attribute__((target("avx2")))
+static float prep_avx2(const float * x, float * sq, unsigned n){
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 m = _mm256_setzero_ps();
+	unsigned i = 0;
+	for(; i + 8 <= n; i += 8){
+		__m256 v = _mm256_loadu_ps(x + i);
+		m = _mm256_max_ps(m, _mm256_and_ps(v, mask));
+		_mm256_storeu_ps(sq + i, _mm256_mul_ps(v, v));
+	}
+	__m128 h = _mm_max_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+	h = _mm_max_ps(h, _mm_movehl_ps(h, h));
+	h = _mm_max_ss(h, _mm_shuffle_ps(h, h, 1));
+	float r = _mm_cvtss_f32(h);
+	float t = prep_c(x + i, sq + i, n - i);
+	return t > r ? t : r;
+}
+#endif
+
+#if defined(__aarch64__) || defined(DSP_ARM_NEON)
+#if defined(DSP_ARM_NEON)
+#pragma GCC push_options
+#pragma GCC target("fpu=neon")
+#endif
+static float prep_neon(const float * x, float * sq, unsigned n){
+	float32x4_t m = vdupq_n_f32(0.0f);
+	unsigned i = 0;
+	for(; i + 4 <= n; i += 4){
+		float32x4_t v = vld1q_f32(x + i);
+		m = vmaxq_f32(m, vabsq_f32(v));
+		vst1q_f32(sq + i, vmulq_f32(v, v));
+	}
+#if defined(__aarch64__)
+	float r = vmaxvq_f32(m);
+#else
+	float32x2_t h = vpmax_f32(vget_low_f32(m), vget_high_f32(m));
+	float r = vget_lane_f32(vpmax_f32(h, h), 0);
+#endif
+	float t = prep_c(x + i, sq + i, n - i);
+	return t > r ? t : r;
+}
+#if defined(DSP_ARM_NEON)
+#pragma GCC pop_options
+#endif
+#endif
+
+/* true peak kernels run over the history followed by the block, so every output has its 12 inputs in one array */
+#define TP_HIST (TP_TAPS - 1)
+
+static inline const float * tp_load(const struct tp_state * s, const float * x, float * buf, unsigned n){
+	memcpy(buf, s->z, sizeof(s->z));
+	memcpy(buf + TP_HIST, x, n * sizeof(float));
+	return buf + TP_HIST; /* p[i - k] is x[i - k] */
+}
+
+static inline void tp_save(struct tp_state * s, const float * buf, unsigned n){
+	memcpy(s->z, buf + n, sizeof(s->z));
+}
+
+/* max magnitude of the 4 phases at p[0] */
+static inline float tp_sample(const float * p){
+	float m = 0.0f;
+	for(unsigned ph = 0; ph < 4; ph++){
+		float y = 0.0f;
+		for(unsigned k = 0; k < TP_TAPS; k++)
+			y += tp_coef[ph][k] * p[-(int)k];
+		y = fabsf(y);
+		if(y > m)
+			m = y;
+	}
+	return m;
+}
+
+static float tp_c(struct tp_state * s, const float * x, float * tp, unsigned n){
+	float buf[TP_HIST + DSP_CHUNK];
+	const float * p = tp_load(s, x, buf, n);
+	float m = 0.0f;
+	for(unsigned i = 0; i < n; i++){
+		tp[i] = tp_sample(p + i);
+		if(tp[i] > m)
+			m = tp[i];
+	}
+	tp_save(s, buf, n);
+	return m;
+}
+
+/* vector versions do consecutive outputs per register, so the max over phases is vertical */
+#if defined(__x86_64__)
+static float tp_sse(struct tp_state * s, const float * x, float * tp, unsigned n){
+	float buf[TP_HIST + DSP_CHUNK];
+	const float * p = tp_load(s, x, buf, n);
+	const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 m = _mm_setzero_ps();
+	unsigned i = 0;
+	for(; i + 4 <= n; i += 4){
+		__m128 y0 = _mm_setzero_ps(), y1 = y0, y2 = y0, y3 = y0;
+		for(unsigned k = 0; k < TP_TAPS; k++){
+			__m128 v = _mm_loadu_ps(p + i - k);
+			y0 = _mm_add_ps(y0, _mm_mul_ps(_mm_set1_ps(tp_coef[0][k]), v));
+			y1 = _mm_add_ps(y1, _mm_mul_ps(_mm_set1_ps(tp_coef[1][k]), v));
+			y2 = _mm_add_ps(y2, _mm_mul_ps(_mm_set1_ps(tp_coef[2][k]), v));
+			y3 = _mm_add_ps(y3, _mm_mul_ps(_mm_set1_ps(tp_coef[3][k]), v));
+		}
+		__m128 t = _mm_max_ps(_mm_max_ps(_mm_and_ps(y0, mask), _mm_and_ps(y1, mask)),
+				_mm_max_ps(_mm_and_ps(y2, mask), _mm_and_ps(y3, mask)));
+		_mm_storeu_ps(tp + i, t);
+		m = _mm_max_ps(m, t);
+	}
+	m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+	m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+	float r = _mm_cvtss_f32(m);
+	for(; i < n; i++){
+		tp[i] = tp_sample(p + i);
+		if(tp[i] > r)
+			r = tp[i];
+	}
+	tp_save(s, buf, n);
+	return r;
+}
+
+__attribute__((target("avx2")))
+static float tp_avx2(struct tp_state * s, const float * x, float * tp, unsigned n){
+	float buf[TP_HIST + DSP_CHUNK];
+	const float * p = tp_load(s, x, buf, n);
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 m = _mm256_setzero_ps();
+	unsigned i = 0;
+	for(; i + 8 <= n; i += 8){
+		__m256 y0 = _mm256_setzero_ps(), y1 = y0, y2 = y0, y3 = y0;
+		for(unsigned k = 0; k < TP_TAPS; k++){
+			__m256 v = _mm256_loadu_ps(p + i - k);
+			y0 = _mm256_add_ps(y0, _mm256_mul_ps(_mm256_set1_ps(tp_coef[0][k]), v));
+			y1 = _mm256_add_ps(y1, _mm256_mul_ps(_mm256_set1_ps(tp_coef[1][k]), v));
+			y2 = _mm256_add_ps(y2, _mm256_mul_ps(_mm256_set1_ps(tp_coef[2][k]), v));
+			y3 = _mm256_add_ps(y3, _mm256_mul_ps(_mm256_set1_ps(tp_coef[3][k]), v));
+		}
+		__m256 t = _mm256_max_ps(_mm256_max_ps(_mm256_and_ps(y0, mask), _mm256_and_ps(y1, mask)),
+				_mm256_max_ps(_mm256_and_ps(y2, mask), _mm256_and_ps(y3, mask)));
+		_mm256_storeu_ps(tp + i, t);
+		m = _mm256_max_ps(m, t);
+	}
+	__m128 h = _mm_max_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+	h = _mm_max_ps(h, _mm_movehl_ps(h, h));
+	h = _mm_max_ss(h, _mm_shuffle_ps(h, h, 1));
+	float r = _mm_cvtss_f32(h);
+	for(; i < n; i++){
+		tp[i] = tp_sample(p + i);
+		if(tp[i] > r)
+			r = tp[i];
+	}
+	tp_save(s, buf, n);
+	return r;
+}
+#endif
+
+#if defined(__aarch64__) || defined(DSP_ARM_NEON)
+#if defined(DSP_ARM_NEON)
+#pragma GCC push_options
+#pragma GCC target("fpu=neon")
+#endif
+static float tp_neon(struct tp_state * s, const float * x, float * tp, unsigned n){
+	float buf[TP_HIST + DSP_CHUNK];
+	const float * p = tp_load(s, x, buf, n);
+	float32x4_t m = vdupq_n_f32(0.0f);
+	unsigned i = 0;
+	for(; i + 4 <= n; i += 4){
+		float32x4_t y0 = vdupq_n_f32(0.0f), y1 = y0, y2 = y0, y3 = y0;
+		for(unsigned k = 0; k < TP_TAPS; k++){
+			float32x4_t v = vld1q_f32(p + i - k);
+			y0 = vmlaq_n_f32(y0, v, tp_coef[0][k]);
+			y1 = vmlaq_n_f32(y1, v, tp_coef[1][k]);
+			y2 = vmlaq_n_f32(y2, v, tp_coef[2][k]);
+			y3 = vmlaq_n_f32(y3, v, tp_coef[3][k]);
+		}
+		float32x4_t t = vmaxq_f32(vmaxq_f32(vabsq_f32(y0), vabsq_f32(y1)), vmaxq_f32(vabsq_f32(y2), vabsq_f32(y3)));
+		vst1q_f32(tp + i, t);
+		m = vmaxq_f32(m, t);
+	}
+#if defined(__aarch64__)
+	float r = vmaxvq_f32(m);
+#else
+	float32x2_t h = vpmax_f32(vget_low_f32(m), vget_high_f32(m));
+	float r = vget_lane_f32(vpmax_f32(h, h), 0);
+#endif
+	for(; i < n; i++){
+		tp[i] = tp_sample(p + i);
+		if(tp[i] > r)
+			r = tp[i];
+	}
+	tp_save(s, buf, n);
+	return r;
+}
+#if defined(DSP_ARM_NEON)
+#pragma GCC pop_options
+#endif
+#endif
+
+dsp_prep_fn dsp_prep = prep_c;
+dsp_tp_fn dsp_true_peak = tp_c;
+const char * dsp_isa = "c";
+
+/* pick the widest instruction set this cpu runs */
+void dsp_init(void){
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")){
+		dsp_prep = prep_avx2;
+		dsp_true_peak = tp_avx2;
+		dsp_isa = "avx2";
+	} else {
+		dsp_prep = prep_sse;
+		dsp_true_peak = tp_sse;
+		dsp_isa = "sse";
+	}
+#elif defined(__aarch64__)
+	dsp_prep = prep_neon;
+	dsp_true_peak = tp_neon;
+	dsp_isa = "neon";
+#elif defined(DSP_ARM_NEON)
+	if(getauxval(AT_HWCAP) & HWCAP_NEON){
+		dsp_prep = prep_neon;
+		dsp_true_peak = tp_neon;
+		dsp_isa = "neon";
+	}
+#endif
+}
+
+/* sum of x[0..n)- 4 accumulators so its not one long chain of dependent adds */
+static inline ftype sum_block(const float * x, unsigned n){
+	ftype a0 = 0.0, a1 = 0.0, a2 = 0.0, a3 = 0.0;
+	unsigned i = 0;
+	for(; i + 4 <= n; i += 4){
+		a0 += x[i];
+		a1 += x[i + 1];
+		a2 += x[i + 2];
+		a3 += x[i + 3];
+	}
+	for(; i < n; i++)
+		a0 += x[i];
+	return (a0 + a1) + (a2 + a3);
+}
+
+/* rms_run() over a block of squared samples, with the state held in registers- sum each sub-block, then a biquad
+ * step. return the offset of the last sample of the sub-block the mean square first went over thres_sq in, or -1,
+ * and the same for the first release under rel_sq in *rel */
+static inline int rms_run_block(const struct rms * rms, struct rms_state * s, const float * sq, unsigned n, int * rel){
+	const struct lowpass * f = &rms->f;
+	ftype x1 = s->f.x1, x2 = s->f.x2, y = s->f.y, d = s->f.d, r = s->f.r;
+	ftype sum = s->_sum_squared;
+	unsigned k = s->_n;
+	int at = -1;
+	for(unsigned i = 0; i < n;){
+		unsigned len = rms->decimate - k;
+		if(len > n - i)
+			len = n - i;
+		sum += sum_block(sq + i, len);
+		i += len;
+		if(((k += len)) < rms->decimate)
+			break;
+		ftype x = sum * rms->_scale;
+		sum = 0.0;
+		k = 0;
+		/* run_lowpass() */
+		d += f->b * (x + 2 * x1 + x2) - f->c * y - f->e * d;
+		ftype t = d - r, u = y + t;
+		r = (u - y) - t;
+		y = u;
+		x2 = x1;
+		x1 = x;
+		if(y < min_level*min_level) /* below noise floor (mean squared, so ^2)*/
+			x1 = x2 = y = d = r = 0.0;
+		if(!s->above){
+			if(y >= rms->thres_sq){
+				s->above = true;
+				if(at < 0)
+					at = i - 1;
+			}
+		} else if(y < rms->rel_sq){
+			s->above = false;
+			if(*rel < 0)
+				*rel = i - 1;
+		}
+	}
+	s->_sum_squared = sum;
+	s->_n = k;
+	s->f.x1 = x1;
+	s->f.x2 = x2;
+	s->f.y = y;
+	s->f.d = d;
+	s->f.r = r;
+	return at;
+}
+
+/* peak_run() for a block x[0..n) starting at sample clock frame, given the max magnitude of the block.
+ * Hold timer is checked at the end of the block and the decay applied once per block.
+ * A new peak starts the hold timer from the sample it happened on, and sets *at to its offset */
+static inline int peak_run_block(const struct peak * peak, struct peak_state * s, const float * x, ftype sample, unsigned n, uint64_t frame, int * at){
+	if(s->_decay_n != n){ /* block size changed- only happens on a jack buffer size change */
+		s->_decay_block = fpow(peak->_decay, (ftype)n);
+		s->_decay_n = n;
+	}
+
+	if(sample < min_level) /* flatten it */
+		sample = 0;
+
+	if(!peak->hold_samples) {
+		if(sample >= s->peak)
+			s->peak = sample;
+		else if (sample > 0)
+			s->peak *= s->_decay_block;
+		else
+			s->peak = 0.0;
+		return 0; /* never trigger events with no hold timer */
+	}
+
+	/* use the peak hold timer */
+	if(sample >= s->peak){
+		s->peak = s->_peak = sample;
+		unsigned i = 0;
+		while(sample > 0 && i < n - 1 && fabsf(x[i]) != sample) /* only on a new peak */
+			i++;
+		set_ftimer(&s->_hold, frame + i, peak->hold_samples);
+		s->event = true;
+		*at = i;
+		return 1;
+	}
+
+	/* get next peak after peak hold expires */
+	if (sample > 0){
+		s->_peak *= s->_decay_block;
+		if(sample >= s->_peak)
+			s->_peak = sample;
+	} else
+		s->_peak = 0.0;
+
+	if(!ftimer_poll(&s->_hold, frame + n)){
+		s->peak = s->_peak;
+		set_ftimer(&s->_hold, frame + n, peak->hold_samples);
+		s->event = true;
+		return 1;
+	}
+
+	return 0;
+}
+
+/* K-weighted sum of squares of x[0..n), both biquads with their state in registers */
+static inline ftype loud_sum(const struct loud * l, struct loud_state * s, const float * x, unsigned n){
+	const struct biquad * a = &l->shelf, * b = &l->hpf;
+	ftype az1 = s->shelf.z1, az2 = s->shelf.z2, bz1 = s->hpf.z1, bz2 = s->hpf.z2;
+	ftype sum = 0.0;
+	for(unsigned i = 0; i < n; i++){
+		ftype v = x[i];
+		ftype y = a->b0 * v + az1;
+		az1 = a->b1 * v - a->a1 * y + az2;
+		az2 = a->b2 * v - a->a2 * y;
+		v = y;
+		y = v + bz1; /* b0 = b2 = 1, b1 = -2 */
+		bz1 = -2.0f * v - b->a1 * y + bz2;
+		bz2 = v - b->a2 * y;
+		sum += y * y;
+	}
+	/* flush state below the noise floor rather than let silence decay into denormals */
+	if(ffabs(az1) + ffabs(az2) < min_level)
+		az1 = az2 = 0.0;
+	if(ffabs(bz1) + ffabs(bz2) < min_level)
+		bz1 = bz2 = 0.0;
+	s->shelf.z1 = az1;
+	s->shelf.z2 = az2;
+	s->hpf.z1 = bz1;
+	s->hpf.z2 = bz2;
+	return sum;
+}
+
+/* loudness over a block starting at sample clock frame- split where 100ms blocks end */
+static inline void loud_run_block(const struct loud * l, struct loud_state * s, const float * x, unsigned n, uint64_t frame){
+	while(n){
+		unsigned len = l->block - frame % l->block;
+		if(len > n)
+			len = n;
+		s->sum += loud_sum(l, s, x, len);
+		s->count += len;
+		x += len;
+		n -= len;
+		frame += len;
+		if(frame % l->block)
+			continue;
+		if(s->count == l->block && s->n < LOUD_DONE)
+			s->done[s->n++] = s->sum;
+		s->sum = 0.0;
+		s->count = 0;
+	}
+}
+
+/* windowed detector over a block of squared samples. return the offset of the segment end it turned on at, or -1,
+ * and where it first turned off in *rel */
+static inline int win_run_block(const struct win * w, struct win_state * s, const float * sq, unsigned n, int * rel){
+	int at = -1;
+	for(unsigned i = 0; i < n;){
+		unsigned len = w->seg - s->k;
+		if(len > n - i)
+			len = n - i;
+		s->acc += sum_block(sq + i, len);
+		i += len;
+		if(((s->k += len)) < w->seg)
+			break;
+
+		/* slide on a segment */
+		s->sum += s->acc - s->segs[s->idx];
+		s->segs[s->idx] = s->acc;
+		s->acc = 0.0;
+		s->k = 0;
+		if(++s->idx == WIN_SEGS){
+			s->idx = 0;
+			s->sum = sum_block(s->segs, WIN_SEGS);
+		}
+		if(s->filled < WIN_SEGS && ++s->filled < WIN_SEGS)
+			continue;
+
+		/* windows ending on this phase are back to back */
+		uint16_t * run = &s->run[s->idx];
+		if(s->sum < w->thres)
+			*run = 0;
+		else if(*run < w->n)
+			(*run)++;
+		if(!s->on){
+			if(*run >= w->n){
+				s->on = true;
+				if(at < 0)
+					at = i - 1;
+			}
+		} else if(s->sum < w->release){
+			s->on = false;
+			if(*rel < 0)
+				*rel = i - 1;
+		}
+	}
+	return at;
+}
+
+/* keep the first level onset and release of the dsp_run() block */
+static inline void level_edges(struct meter_state * s, unsigned base, int at, int rel){
+	if(at >= 0 && s->level_at < 0)
+		s->level_at = base + at;
+	if(rel >= 0 && s->release_at < 0)
+		s->release_at = base + rel;
+}
+
+/* process a block of samples starting at sample clock frame. Vector pass gets magnitude max and squares,
+ * then the feedback parts run over the results. In true peak mode peak and clip see the oversampled
+ * magnitudes, which lag the input by the filter delay of ~6 samples.
+ * Return accumulated events, with the offset of the first of each kind in s->*_at */
+int dsp_run(struct meter * m, struct meter_state * s, const float * x, unsigned n, uint64_t frame){
+	float sq[DSP_CHUNK], tp[DSP_CHUNK];
+	int events = 0;
+	unsigned base = 0;
+	s->clip_at = s->peak_at = s->level_at = s->release_at = -1;
+	s->loud.n = 0;
+
+	while(n){
+		unsigned len = n < DSP_CHUNK ? n : DSP_CHUNK;
+		float max = dsp_prep(x, sq, len);
+		const float * pk = x;
+		if(m->true_peak){
+			max = dsp_true_peak(&s->tp, x, tp, len);
+			pk = tp;
+		}
+
+		if(m->rms.en){
+			int rel = -1, at = rms_run_block(&m->rms, &s->rms, sq, len, &rel);
+			level_edges(s, base, at, rel);
+			events += s->rms.f.y != 0.0;
+		}
+		if(m->win.en){
+			int rel = -1, at = win_run_block(&m->win, &s->win, sq, len, &rel);
+			level_edges(s, base, at, rel);
+		}
+		if(m->loud.en)
+			loud_run_block(&m->loud, &s->loud, x, len, frame);
+		if(m->peak.decay_samples){
+			int at = -1;
+			events += peak_run_block(&m->peak, &s->peak, pk, max, len, frame, &at);
+			if(at >= 0 && s->peak_at < 0)
+				s->peak_at = base + at;
+		}
+		if(m->clip.threshold){
+			if(max < CLIP_LEVEL)
+				s->clip.n = 0; /* nothing saturated- no run to count */
+			else
+				for(unsigned i = 0; i < len; i++)
+					if(clip_run(&m->clip, &s->clip, fabsf(pk[i]))){
+						if(s->clip_at < 0)
+							s->clip_at = base + i;
+						events++;
+					}
+		}
+		x += len;
+		n -= len;
+		frame += len;
+		base += len;
+	}
+	s->pending += events;
+	return events;
+}
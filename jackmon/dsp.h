@@ -0,0 +1,343 @@
+/*
+ * dsp.h
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#ifndef DSP_H_
+#define DSP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "utils.h"
+
+/* Meter config (struct rms, peak, clip) is the same for every channel so its shared,
+ * and read only in the realtime thread. Per channel state (struct *_state) is only
+ * touched by the realtime thread and is packed into one cache line aligned struct meter_state */
+
+struct biquad {
+	ftype b0, b1, b2;
+	ftype a1, a2;
+};
+
+struct biquad_state {
+	ftype z1, z2;
+	ftype y;
+};
+
+/* the rms smoothing filter- a 2nd order Butterworth low pass in delta form. Its poles are close to 1, where a1 and a2
+ * lose the small differences from 2 and 1 that set the response in float. So it keeps those differences and steps the
+ * change in output, carrying the rounding of adding that to y (Kahan) so it holds level in float at any rate */
+struct lowpass {
+	ftype b; /* b0 = b2 = b, b1 = 2b */
+	ftype c; /* 1 + a1 + a2 */
+	ftype e; /* 1 - a2 */
+};
+
+struct lowpass_state {
+	ftype x1, x2; /* last inputs */
+	ftype y;
+	ftype d; /* y less the one before */
+	ftype r; /* rounding left out of y */
+};
+
+/* the 6Hz smoothing filter runs on the mean square of sub-blocks of decimate samples, at 1-2kHz */
+#define RMS_RATE_MIN 1000.0
+
+struct rms {
+	bool en;
+	unsigned decimate; /* squared samples averaged per filter step */
+	ftype _scale; /* 1/decimate */
+	struct lowpass f; /* at samplerate/decimate */
+	ftype thres_sq; /* level threshold on the mean square for onset events- INFINITY for none */
+	ftype rel_sq; /* release threshold, at or under thres_sq- dropping under it after an onset is a release */
+};
+
+struct rms_state {
+	struct lowpass_state f;
+	ftype _sum_squared; /* sum of squares so far in this sub-block */
+	unsigned _n; /* samples in it */
+	bool above; /* between an onset and a release */
+};
+
+/* BS.1770 loudness- K-weighted (high shelf then high pass) sum of squares over 100ms blocks on the sample clock.
+ * Completed blocks are summed over channels in audio_process() and gated on the main loop- see loudness.h */
+#define LOUD_DONE 8 /* completed blocks one dsp_run() call can return- a period of up to 800ms */
+
+struct loud {
+	bool en;
+	struct biquad shelf;
+	struct biquad hpf;
+	unsigned block; /* samples per 100ms block */
+};
+
+struct loud_state {
+	struct biquad_state shelf, hpf; /* z1, z2 only */
+	ftype sum; /* sum of squares so far in this block */
+	unsigned count; /* samples so far in this block- the first block after start is partial, and dropped */
+	unsigned n; /* blocks completed in the last dsp_run() */
+	float done[LOUD_DONE]; /* their sums of squares */
+};
+
+/* windowed level detector- mean square over a sliding window, kept as a running sum of WIN_SEGS segment sums so
+ * memory and cost don't depend on the window length. Triggers when n back to back windows are all over threshold,
+ * checked every segment, so a burst shorter than the windows never does */
+#define WIN_SEGS 16
+
+struct win {
+	bool en;
+	unsigned seg; /* samples per segment */
+	unsigned n; /* consecutive windows over threshold to trigger */
+	ftype thres; /* threshold on the window sum of squares */
+	ftype release; /* once on, it stays on until a window sum is under this */
+	ftype _scale; /* 1/window samples */
+};
+
+struct win_state {
+	float segs[WIN_SEGS]; /* sums of squares of the last WIN_SEGS segments- a window */
+	ftype sum; /* of segs, re-summed each time round so rounding doesn't build up */
+	ftype acc; /* segment so far */
+	unsigned k; /* samples in it */
+	unsigned idx; /* next segment to replace */
+	unsigned filled; /* segments since start, up to WIN_SEGS */
+	uint16_t run[WIN_SEGS]; /* consecutive windows over threshold ending on each segment phase, up to n */
+	bool on; /* a run of n windows completed, and no window since has been under the release threshold */
+};
+
+struct peak {
+	unsigned hold_samples; /* peak hold time in samples */
+	unsigned decay_samples; /* number of samples to decay over */
+	ftype decay_atten; /* final value to decay to after samples - eg 0.001 */
+	ftype _decay; /* constant decay multiplier per sample */
+};
+
+struct peak_state {
+	ftype peak; /* output peak */
+	ftype _peak; /* decaying peak value to comare new samples, and update for when peak hold expires if we don't exceed it */
+	uint64_t _hold; /* peak hold timer- sample clock frame it expires at */
+	bool event; /* set here, cleared when published */
+	unsigned _decay_n; /* block size _decay_block was calculated for */
+	ftype _decay_block; /* decay multiplier per block of _decay_n samples */
+};
+
+struct clip {
+	unsigned threshold; /* number of consecutive samples overloaded to flag clip */
+};
+
+struct clip_state {
+	bool event; /* set here, cleared when published */
+	unsigned n; /* consecutive clipped samples */
+};
+
+/* true peak- 4x oversampled per BS.1770 annex 2, with a 12 tap filter per phase */
+#define TP_TAPS 12
+
+struct tp_state {
+	float z[TP_TAPS - 1]; /* last input samples */
+};
+
+/* shared by all channels */
+struct meter {
+	struct rms rms;
+	struct peak peak;
+	struct clip clip;
+	struct loud loud;
+	struct win win;
+	bool true_peak; /* peak and clip see the oversampled magnitude instead of sample values */
+};
+
+/* per channel, realtime thread only */
+struct meter_state {
+	struct rms_state rms;
+	struct peak_state peak;
+	struct clip_state clip;
+	struct tp_state tp;
+	struct loud_state loud;
+	struct win_state win;
+	unsigned pending; /* events since last publish */
+	/* sample offset of the first clip, new peak, level onset and level release in the last dsp_run() block, -1 for none.
+	 * The level detectors end up on if rms.above or win.on */
+	int clip_at, peak_at, level_at, release_at;
+} __attribute__((aligned(CACHELINE)));
+
+static inline void run_lowpass(ftype x, const struct lowpass * f, struct lowpass_state * s){
+	ftype d = s->d + f->b * (x + 2 * s->x1 + s->x2) - f->c * s->y - f->e * s->d;
+	ftype t = d - s->r, y = s->y + t;
+	s->r = (y - s->y) - t;
+	s->x2 = s->x1;
+	s->x1 = x;
+	if(y < min_level*min_level) /* below noise floor (mean squared, so ^2)*/
+		s->x1 = s->x2 = s->y = s->d = s->r = 0.0;
+	else {
+		s->d = d;
+		s->y = y;
+	}
+}
+
+void rms_init(struct rms * rms, double samplerate, unsigned decimate);
+
+/* return 1 if RMS value becomes ready */
+static inline int rms_run(const struct rms * rms, struct rms_state * s, ftype sample) {
+	if(!rms->en)
+		return 0; /* disabled */
+	s->_sum_squared += sample*sample;
+	if(++s->_n >= rms->decimate){
+		run_lowpass(s->_sum_squared * rms->_scale, &rms->f, &s->f);
+		s->_sum_squared = 0.0;
+		s->_n = 0;
+	}
+	return s->f.y != 0.0;
+}
+
+static inline ftype rms_get(const struct rms_state * s){
+	return s->f.y ? sqrtff(s->f.y) : 0.0;
+}
+
+void loud_init(struct loud * loud, double samplerate);
+void win_init(struct win * win, unsigned samples, unsigned n, ftype thres, ftype release);
+
+/* mean square of the latest window */
+static inline ftype win_get(const struct win * win, const struct win_state * s){
+	return s->filled < WIN_SEGS ? 0.0 : s->sum * win->_scale;
+}
+
+
+void peak_init(struct peak * peak, ftype atten, unsigned decay_samples, unsigned hold_samples);
+
+/* track max sample for hold_samples, with a decay used after timer expires.
+ * frame is the sample clock of this sample. return 1 if peak changes */
+static inline int peak_run(const struct peak * peak, struct peak_state * s, ftype sample, uint64_t frame){
+	if(sample < min_level) /* flatten it */
+		sample = 0;
+
+	if(!peak->hold_samples) {
+		if(sample >= s->peak)
+			s->peak = sample;
+		else if (sample > 0)
+			s->peak *= peak->_decay;
+		else
+			s->peak = 0.0;
+		return 0; /* never trigger events with no hold timer */
+	}
+
+	/* use the peak hold timer */
+	if(sample >= s->peak){
+		s->peak = s->_peak = sample;
+		goto peak_detected;
+	}
+
+	/* get next peak after peak hold expires */
+	if(sample >= s->_peak)
+		s->_peak = sample;
+	else if (sample > 0)
+		s->_peak *= peak->_decay;
+	else
+		s->_peak = 0.0;
+
+	if(!ftimer_poll(&s->_hold, frame)){
+		s->peak = s->_peak;
+		goto peak_detected;
+	}
+
+	return 0;
+
+peak_detected:
+	set_ftimer(&s->_hold, frame, peak->hold_samples);
+	s->event = true;
+	return 1;
+}
+
+/* grab peak value. return true if peak value updated on hold timer. */
+static inline bool peak_get(struct peak_state * s, ftype * val){
+	*val = s->peak;
+	if(!s->event)
+		return false;
+	s->event = false;
+	return true;
+}
+
+/* clip level- a sample at or above this is saturated */
+#define CLIP_LEVEL 0.9999f
+
+void clip_init(struct clip * clip, unsigned threshold);
+
+/* flag clip if overloaded mode than threshold samples in a row.
+ * If we triggered event, return 1, otherwise 0 */
+static inline int clip_run(const struct clip * clip, struct clip_state * s, ftype sample){
+	if (sample >= CLIP_LEVEL) {
+		if(++s->n >= clip->threshold){
+			s->event = true; /* cleared when published */
+			return 1;
+		}
+	} else
+		s->n = 0;
+	return 0;
+}
+
+/* return true if clip tripped on this channel since last call */
+static inline bool clip_get(struct clip_state * s){
+	if(!s->event)
+		return false;
+	s->event = false;
+	return true;
+}
+
+/* gain gate for the level_gate output ports- follows the level trigger in the realtime thread, so it opens on the
+ * onset sample and closes hold samples after the last channel releases, with a linear ramp both ways. One state for
+ * all channels so they open and close together */
+struct gate {
+	bool en;
+	ftype step; /* gain change per sample- 1/ramp samples */
+	uint64_t hold; /* samples from the last release to closing */
+};
+
+struct gate_state {
+	bool open; /* where the gain is heading */
+	uint64_t close_at; /* sample clock the hold runs out- 0 while a channel is on, or closed */
+	ftype g0, g1; /* gain at the start and end of this block */
+	unsigned at; /* sample offset this blocks ramp starts at */
+};
+
+void gate_init(struct gate * g, unsigned ramp, uint64_t hold);
+void gate_run(const struct gate * g, struct gate_state * s, bool on, int onset, int release, uint64_t frame, unsigned n);
+
+/* y = x times the gain over the block from gate_run(). Open or closed its a copy or silence */
+static inline void gate_apply(const struct gate * g, const struct gate_state * s, const float * x, float * y, unsigned n){
+	ftype gain = s->g0, d = s->open ? g->step : -g->step;
+	unsigned k = s->at < n ? s->at : n;
+	if(gain == s->g1 && (gain == 0.0 || gain == 1.0)){
+		if(gain == 0.0)
+			memset(y, 0, n * sizeof(float));
+		else if(x != y)
+			memcpy(y, x, n * sizeof(float));
+		return;
+	}
+	for(unsigned i = 0; i < k; i++)
+		y[i] = x[i] * gain;
+	for(unsigned i = k; i < n; i++){
+		ftype gi = gain + d * (i - k + 1); /* as gate_run() works out g1, so the next block carries on from it */
+		y[i] = x[i] * (gi < 0.0 ? 0.0 : gi > 1.0 ? 1.0 : gi);
+	}
+}
+
+/* block kernel primitive: return max magnitude of x[0..n) and write x^2 to sq[0..n) */
+typedef float (*dsp_prep_fn)(const float * x, float * sq, unsigned n);
+extern dsp_prep_fn dsp_prep;
+/* true peak primitive: return max oversampled magnitude of x[0..n) and write each samples to tp[0..n). n <= DSP_CHUNK */
+typedef float (*dsp_tp_fn)(struct tp_state * s, const float * x, float * tp, unsigned n);
+extern dsp_tp_fn dsp_true_peak;
+extern const char * dsp_isa; /* name of the instruction set dsp_prep uses */
+
+void dsp_init(void);
+int dsp_run(struct meter * m, struct meter_state * s, const float * x, unsigned n, uint64_t frame);
+
+/* level detector state after the last dsp_run()- the windowed one if its enabled */
+static inline bool dsp_level_on(const struct meter * m, const struct meter_state * s){
+	return m->win.en ? s->win.on : s->rms.above;
+}
+
+#endif /* DSP_H_ */
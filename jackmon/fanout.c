@@ -0,0 +1,164 @@
+/*
+ * fanout.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Helper threads for the channel fan-out, and the barriers between them and the caller. See fanout.h
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "fanout.h"
+
+static void futex_wait(atomic_uint * addr, unsigned val){
+	syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_uint * addr, int n){
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+static inline void cpu_relax(void){
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/* part p of the channels, contiguous so each channel's state stays on one core */
+static inline void fanout_range(const struct fanout * f, unsigned p, unsigned * from, unsigned * to){
+	*from = (uint64_t)f->n * p / (f->threads + 1);
+	*to = (uint64_t)f->n * (p + 1) / (f->threads + 1);
+}
+
+static void * fanout_thread(void * arg){
+	struct fanout_part * part = arg;
+	struct fanout * f = part->f;
+	unsigned seen = 0; /* gen before the first cycle- it may have started before this thread did */
+	while(true){
+		/* wait for the next cycle- spin a little, then sleep. The caller wakes sleepers after it bumps gen */
+		unsigned gen;
+		for(unsigned i = 0; (gen = atomic_load_explicit(&f->gen, memory_order_acquire)) == seen; i++){
+			if(i < f->spin){
+				cpu_relax();
+				continue;
+			}
+			atomic_fetch_add(&f->sleeping, 1);
+			if(atomic_load(&f->gen) == seen)
+				futex_wait(&f->gen, seen);
+			atomic_fetch_sub(&f->sleeping, 1);
+		}
+		seen = gen;
+		if(atomic_load_explicit(&f->stop, memory_order_acquire))
+			break;
+
+		unsigned from, to;
+		fanout_range(f, part->index, &from, &to);
+		part->events = from < to ? f->fn(f->arg, from, to) : 0;
+		if(atomic_fetch_add(&f->done, 1) + 1 == f->threads && atomic_load(&f->waiting))
+			futex_wake(&f->done, 1);
+	}
+	return NULL;
+}
+
+/* start threads helpers at realtime priority, or normal scheduling for 0. They fan out cycles of min channels or more */
+struct fanout * fanout_init(unsigned threads, unsigned min, int priority){
+	if(threads > FANOUT_MAX)
+		threads = FANOUT_MAX;
+	struct fanout * f = aligned_calloc(1, sizeof(struct fanout));
+	if(!f)
+		return NULL;
+	f->min = min;
+	f->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? FANOUT_SPIN : 0; /* one core- spinning only holds up the others */
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	if(priority > 0){
+		struct sched_param param = { .sched_priority = priority };
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+	for(unsigned i = 0; i < threads; i++){
+		struct fanout_part * part = &f->part[i];
+		part->f = f;
+		part->index = i + 1; /* the caller is part 0 */
+		errno = pthread_create(&part->thread, &attr, fanout_thread, part);
+		if(errno == EPERM && priority > 0){ /* not allowed realtime- better than nothing */
+			fprintf(stderr, "fanout: no realtime priority, using normal scheduling\n");
+			pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+			priority = 0;
+			errno = pthread_create(&part->thread, &attr, fanout_thread, part);
+		}
+		if(errno){
+			perror("fanout thread");
+			break;
+		}
+		f->threads++;
+	}
+	pthread_attr_destroy(&attr);
+	return f;
+}
+
+/* stop the helpers and free. Not while a cycle is running */
+void fanout_free(struct fanout * f){
+	if(!f)
+		return;
+	atomic_store_explicit(&f->stop, true, memory_order_release);
+	atomic_fetch_add(&f->gen, 1);
+	futex_wake(&f->gen, INT_MAX);
+	for(unsigned i = 0; i < f->threads; i++)
+		pthread_join(f->part[i].thread, NULL);
+	free(f);
+}
+
+/* run fn over channels [0, n), split across the helpers and this thread if there are enough of them.
+ * return the events. Only one thread calls this */
+unsigned fanout_run(struct fanout * f, fanout_fn fn, void * arg, unsigned n){
+	if(!f || !f->threads || n < f->min){
+		if(f)
+			f->serial++;
+		return fn(arg, 0, n);
+	}
+	f->fn = fn;
+	f->arg = arg;
+	f->n = n;
+	atomic_store_explicit(&f->done, 0, memory_order_relaxed);
+	atomic_fetch_add(&f->gen, 1); /* publishes the cycle */
+	if(atomic_load(&f->sleeping))
+		futex_wake(&f->gen, INT_MAX);
+
+	unsigned from, to;
+	fanout_range(f, 0, &from, &to);
+	unsigned events = fn(arg, from, to);
+
+	/* wait for the helpers- they finish about when this does, so spin first */
+	unsigned done;
+	for(unsigned i = 0; (done = atomic_load_explicit(&f->done, memory_order_acquire)) != f->threads; i++){
+		if(i < f->spin){
+			cpu_relax();
+			continue;
+		}
+		atomic_store(&f->waiting, true);
+		if(atomic_load(&f->done) == done)
+			futex_wait(&f->done, done);
+		atomic_store(&f->waiting, false);
+	}
+	for(unsigned i = 0; i < f->threads; i++)
+		events += f->part[i].events;
+	f->cycles++;
+	return events;
+}
+
+void fanout_print(struct fanout * f, const char * prefix, FILE * fp){
+	fprintf(fp, "%sfanout: %u helper threads from %u channels, %llu cycles fanned out, %llu serial\n", prefix,
+			f->threads, f->min, (unsigned long long)f->cycles, (unsigned long long)f->serial);
+}
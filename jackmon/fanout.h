@@ -0,0 +1,62 @@
+/*
+ * fanout.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Channel fan-out, fanout = N in the config- N realtime helper threads, started once, that split the channel bank
+ * with the thread running the meters each cycle. Each takes a contiguous range of channels, so no two share a
+ * channel's state. The cycle is handed over and collected with futex barriers, spinning briefly first, and nothing
+ * is allocated or locked. Under fanout_min channels the meters run serially as before- handing over costs more than
+ * it saves on a few channels.
+ */
+
+#ifndef FANOUT_H_
+#define FANOUT_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "utils.h"
+
+#define FANOUT_MAX 16 /* helper threads */
+#define FANOUT_SPIN 4000 /* polls before sleeping on a barrier- tens of microseconds */
+
+/* run channels [from, to). return the events */
+typedef unsigned (*fanout_fn)(void * arg, unsigned from, unsigned to);
+
+struct fanout_part {
+	_Alignas(CACHELINE) unsigned events; /* the helpers result this cycle */
+	struct fanout * f;
+	unsigned index;
+	pthread_t thread;
+};
+
+struct fanout {
+	/* the cycle- written by the caller before gen */
+	fanout_fn fn;
+	void * arg;
+	unsigned n;
+	_Alignas(CACHELINE) atomic_uint gen; /* bumped to start a cycle- helpers wait on it */
+	atomic_uint sleeping; /* helpers asleep on gen */
+	atomic_bool stop;
+	_Alignas(CACHELINE) atomic_uint done; /* helpers finished this cycle- the caller waits on it */
+	atomic_bool waiting; /* the caller is asleep on done */
+
+	/* config */
+	_Alignas(CACHELINE) unsigned threads;
+	unsigned min; /* channels to fan out at */
+	unsigned spin; /* FANOUT_SPIN, or 0 on one core */
+	struct fanout_part part[FANOUT_MAX];
+
+	/* caller only */
+	uint64_t cycles, serial; /* fanned out, and run serially */
+};
+
+struct fanout * fanout_init(unsigned threads, unsigned min, int priority);
+void fanout_free(struct fanout * f);
+unsigned fanout_run(struct fanout * f, fanout_fn fn, void * arg, unsigned n);
+void fanout_print(struct fanout * f, const char * prefix, FILE * fp);
+
+#endif /* FANOUT_H_ */
@@ -0,0 +1,332 @@
+/*
+ * gpio.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * GPIO outputs with handles held open- legacy sysfs, or the character device line request interface.
+ * Character device lines on one chip share one request, and changes are sent together by gpio_flush().
+ * Main loop only.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/gpio.h>
+
+#include "gpio.h"
+
+#define GPIO_PID_DIR "/dev/shm/gpio" /* for GPIO_SYSFS_ROOT- another root keeps them in its own pid directory */
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+/* all our lines on one character device */
+struct gpio_chip {
+	char * path;
+	int fd;
+	int req_fd; /* line request for every line below */
+	unsigned n;
+	uint32_t offsets[GPIO_V2_LINES_MAX];
+	uint64_t active_low; /* bit per line */
+	uint64_t vals; /* bit per line */
+	uint64_t dirty; /* changed since last flush */
+	struct gpio_chip * next;
+};
+static struct gpio_chip * chips;
+#endif
+
+struct gpio_line {
+	const char * root;
+	const char * chip;
+	int gpio;
+	bool failed; /* reported an error already */
+	bool val;
+	const struct gpio_info * owner; /* last in this process to set it */
+	int value_fd; /* sysfs */
+	int pid_fd; /* sysfs- pid of the last process to set it */
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	struct gpio_chip * c; /* character device */
+	unsigned bit;
+#endif
+	struct gpio_line * next;
+};
+static struct gpio_line * lines;
+
+static bool same(const char * a, const char * b){
+	return a == b || (a && b && !strcmp(a, b));
+}
+
+/* return -1 for open error, 1 for write error, 0 for OK */
+static int write_sysfs(const char *path, const char *value)
+{
+    int fd = open(path, O_WRONLY);
+    if (fd < 0)
+        return -1; /* dont print error- can get permissions error immediately after export if udev hasn't kicked in yet */
+
+    if (write(fd, value, strlen(value)) < 0) {
+    	fprintf(stderr, "Failed to write %s: %d: %s\n", path, errno, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    close(fd);
+    return 0;
+}
+
+/* export and set up the line, then keep the value and pid files open */
+static int sysfs_open(struct gpio_line * l, bool active_low, const char * name){
+	char path[256];
+	snprintf(path, sizeof(path), "%s/gpio%d/direction", l->root, l->gpio);
+
+	/* if direction file doesn't exist, we need to export the GPIO */
+	struct stat st;
+	if(stat(path, &st)){
+		char export[256], s[16];
+		snprintf(export, sizeof(export), "%s/export", l->root);
+		snprintf(s, sizeof(s), "%d", l->gpio);
+		if(write_sysfs(export, s) < 0)
+			return -1;
+		fprintf(stderr, "Exported gpio%d for %s\n", l->gpio, name);
+	}
+
+	if(write_sysfs(path, "out") < 0)
+		return -1;
+	snprintf(path, sizeof(path), "%s/gpio%d/active_low", l->root, l->gpio);
+	if(write_sysfs(path, active_low ? "1" : "0") < 0)
+		return -1;
+	snprintf(path, sizeof(path), "%s/gpio%d/value", l->root, l->gpio);
+	if((l->value_fd = open(path, O_WRONLY | O_CLOEXEC)) < 0)
+		return -1;
+
+	/* track GPIO set owner between processes */
+	if(strcmp(l->root, GPIO_SYSFS_ROOT))
+		snprintf(path, sizeof(path), "%s/pid", l->root);
+	else
+		snprintf(path, sizeof(path), "%s", GPIO_PID_DIR);
+	mkdir(path, 0755); /* ignore response */
+	size_t len = strlen(path);
+	snprintf(path + len, sizeof(path) - len, "/gpio%d", l->gpio);
+	if((l->pid_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0)
+		fprintf(stderr, "Failed to open GPIO track file %s\n", path);
+	return 0;
+}
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+/* (re)request every line on the chip as outputs in one request, keeping their values */
+static int chip_request(struct gpio_chip * c, unsigned n){
+	struct gpio_v2_line_request req;
+	memset(&req, 0, sizeof(req));
+	memcpy(req.offsets, c->offsets, n * sizeof(uint32_t));
+	strcpy(req.consumer, "jackmon");
+	req.num_lines = n;
+	req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+	uint64_t all = n == 64 ? ~0ULL : (1ULL << n) - 1;
+	req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+	req.config.attrs[0].attr.values = c->vals;
+	req.config.attrs[0].mask = all;
+	req.config.num_attrs = 1;
+	if(c->active_low & all){
+		req.config.attrs[1].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+		req.config.attrs[1].attr.flags = GPIO_V2_LINE_FLAG_OUTPUT | GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+		req.config.attrs[1].mask = c->active_low & all;
+		req.config.num_attrs = 2;
+	}
+
+	/* lines are exclusive- drop the old request first */
+	if(c->req_fd >= 0)
+		close(c->req_fd);
+	c->req_fd = -1;
+	if(ioctl(c->fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0)
+		return -1;
+	c->req_fd = req.fd;
+	return 0;
+}
+
+/* add the line to its chips request */
+static int chip_open(struct gpio_line * l, bool active_low){
+	char * path = NULL;
+	if(asprintf(&path, "%s%s", l->chip[0] == '/' ? "" : "/dev/", l->chip) < 0)
+		return -1;
+
+	struct gpio_chip * c;
+	for(c = chips; c && strcmp(c->path, path); c = c->next)
+		;
+	if(c)
+		free(path);
+	else {
+		int fd = open(path, O_RDWR | O_CLOEXEC);
+		if(fd < 0 || !((c = calloc(1, sizeof(*c))))){
+			free(path);
+			if(fd >= 0)
+				close(fd);
+			return -1;
+		}
+		c->path = path;
+		c->fd = fd;
+		c->req_fd = -1;
+		c->next = chips;
+		chips = c;
+	}
+
+	if(c->n == GPIO_V2_LINES_MAX){
+		errno = ENOSPC;
+		return -1;
+	}
+	unsigned bit = c->n;
+	c->offsets[bit] = l->gpio;
+	c->active_low = (c->active_low & ~(1ULL << bit)) | (uint64_t)active_low << bit;
+	c->vals &= ~(1ULL << bit);
+	if(chip_request(c, c->n + 1)){
+		int err = errno;
+		if(c->n)
+			chip_request(c, c->n); /* put the others back */
+		errno = err;
+		return -1;
+	}
+	c->n++;
+	l->c = c;
+	l->bit = bit;
+	return 0;
+}
+#endif
+
+/* find the open line, or open it */
+static struct gpio_line * line_open(struct gpio_info * gpio){
+	const char * root = gpio->root ?: GPIO_SYSFS_ROOT;
+	struct gpio_line * l;
+	for(l = lines; l; l = l->next)
+		if(l->gpio == gpio->gpio && !strcmp(l->root, root) && same(l->chip, gpio->chip))
+			return l;
+
+	if(!((l = calloc(1, sizeof(*l)))))
+		return NULL;
+	l->root = root;
+	l->chip = gpio->chip;
+	l->gpio = gpio->gpio;
+	l->value_fd = l->pid_fd = -1;
+
+	int err;
+	if(l->chip){
+#ifdef GPIO_V2_GET_LINE_IOCTL
+		err = chip_open(l, gpio->active_low);
+#else
+		errno = ENOTSUP;
+		err = -1;
+#endif
+		if(err && !gpio->_reported) /* once- its retried every main loop */
+			fprintf(stderr, "Can't request %s line %d for %s: %s\n", l->chip, l->gpio, gpio->name, strerror(errno));
+		gpio->_reported = err;
+	} else
+		err = sysfs_open(l, gpio->active_low, gpio->name); /* quiet- retried until udev sets permissions */
+
+	if(err){
+		if(l->value_fd >= 0)
+			close(l->value_fd);
+		if(l->pid_fd >= 0)
+			close(l->pid_fd);
+		free(l);
+		return NULL;
+	}
+	l->next = lines;
+	lines = l;
+	return l;
+}
+
+int gpio_init(struct gpio_info * gpio){
+	if(gpio->initialised)
+		return 0;
+
+	if(!gpio->gpio)
+		return -1; /* no GPIO */
+
+	if(gpio->gpio < 0){
+		gpio->active_low = true;
+		gpio->gpio = -gpio->gpio;
+	}
+
+	if(!((gpio->_line = line_open(gpio))))
+		return -1;
+
+	gpio->initialised = true;
+	fprintf(stderr, "Initialised GPIO %s, %s %d, Active %s\n", gpio->name, gpio->chip ?: "port", gpio->gpio,
+			gpio->active_low ? "Low" : "High");
+
+	/* try set to off by default if we just exported it- otherwise assume its correct */
+	if(gpio_set(gpio, gpio->val) < 0)
+		return -1;
+	return 0;
+}
+
+static int line_write(struct gpio_line * l, bool value){
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	if(l->c){ /* batched- sent by gpio_flush() */
+		l->c->vals = (l->c->vals & ~(1ULL << l->bit)) | (uint64_t)value << l->bit;
+		l->c->dirty |= 1ULL << l->bit;
+		l->val = value;
+		return 0;
+	}
+#endif
+	if(pwrite(l->value_fd, value ? "1" : "0", 1, 0) < 0){
+		if(!l->failed)
+			fprintf(stderr, "Failed to write gpio%d: %s\n", l->gpio, strerror(errno));
+		l->failed = true;
+		return 1;
+	}
+	l->val = value;
+	return 0;
+}
+
+/* set the line, but only clear it if we were the last to set it- in this process, or for sysfs any process */
+int gpio_set(struct gpio_info * gpio, bool value){
+	int err;
+	gpio->val = value; /* update in case init fails on udev permissions or export not set up yet, and we do it later */
+	if((err = gpio_init(gpio)))
+		return err;
+
+	struct gpio_line * l = gpio->_line;
+	int pid = getpid();
+	char s[16];
+	if(value){
+		l->owner = gpio;
+		if(l->pid_fd >= 0){ /* write pid to gpio tracking file */
+			int n = snprintf(s, sizeof(s), "%d", pid);
+			if(ftruncate(l->pid_fd, 0) || pwrite(l->pid_fd, s, n, 0) < 0)
+				fprintf(stderr, "Failed to write GPIO track file for gpio%d\n", l->gpio);
+		}
+	} else {
+		if(l->owner && l->owner != gpio)
+			return 0; /* someone else here has it */
+		l->owner = NULL;
+		if(l->pid_fd >= 0){ /* read back the pid that last set the gpio, and only clear if it was us, or we cant read it */
+			ssize_t n = pread(l->pid_fd, s, sizeof(s) - 1, 0);
+			if(n > 0){
+				s[n] = 0;
+				if(atoi(s) != pid)
+					return 0;
+			}
+		}
+	}
+	return line_write(l, value);
+}
+
+/* send batched character device changes- one ioctl per chip */
+int gpio_flush(void){
+	int err = 0;
+#ifdef GPIO_V2_GET_LINE_IOCTL
+	for(struct gpio_chip * c = chips; c; c = c->next){
+		if(!c->dirty || c->req_fd < 0)
+			continue;
+		struct gpio_v2_line_values v = { .bits = c->vals, .mask = c->dirty };
+		if(ioctl(c->req_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &v) < 0){
+			fprintf(stderr, "Failed to set %s lines: %s\n", c->path, strerror(errno));
+			err = -1;
+		}
+		c->dirty = 0;
+	}
+#endif
+	return err;
+}
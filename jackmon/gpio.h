@@ -0,0 +1,32 @@
+/*
+ * gpio.h
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#ifndef GPIO_H_
+#define GPIO_H_
+
+#include <stdbool.h>
+
+#define GPIO_SYSFS_ROOT "/sys/class/gpio"
+
+struct gpio_line;
+
+struct gpio_info {
+	int gpio; /* sysfs number, or line offset with chip. Negative for active low until initialised */
+	bool initialised;
+	bool active_low;
+	bool val;
+	char * name;
+	const char * root; /* sysfs gpio directory- default GPIO_SYSFS_ROOT */
+	const char * chip; /* character device eg gpiochip0- use line requests instead of sysfs */
+	struct gpio_line * _line; /* open handles- shared by every gpio_info on the same line */
+	bool _reported; /* failed to open already reported */
+};
+
+int gpio_init(struct gpio_info * gpio);
+int gpio_set(struct gpio_info * gpio, bool value);
+int gpio_flush(void);
+
+#endif /* GPIO_H_ */
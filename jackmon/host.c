@@ -0,0 +1,219 @@
+/*
+ * host.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Runs any number of monitor contexts in one jack client- one process callback
+ * and one main loop, so each extra config doesn't cost another client in the graph.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <poll.h>
+
+#include "utils.h"
+#include "host.h"
+
+static int host_process(jack_nframes_t nframes, void *arg){
+	struct host * host = (struct host *)arg;
+	uint64_t t0 = host->prof ? prof_ticks() : 0;
+	/* extend the 32 bit frame time- it wraps after a day at 48kHz */
+	jack_nframes_t jframe = jack_last_frame_time(host->jclient);
+	uint64_t frame = host->frame + (uint32_t)(jframe - (uint32_t)host->frame);
+	host->frame = frame + nframes;
+	if(!host->started){
+		host->started = true; /* skip first frame */
+		return 0;
+	}
+
+	for (unsigned c = 0; c < host->n; c++)
+		audio_jack_process(&host->ctx[c]->audio, frame, nframes);
+	if(host->prof)
+		prof_cycle_end(host->prof, t0, nframes);
+	return 0;
+}
+
+static int host_xrun(void *arg){
+	prof_xrun(((struct host *)arg)->prof);
+	return 0;
+}
+
+static void host_connect_cb(jack_port_id_t a, jack_port_id_t b, int connect, void *arg){
+	struct host * host = (struct host *)arg;
+	if(connect) /* disconnects only */
+		return;
+
+	jack_port_t *src = jack_port_by_id(host->jclient, a);
+	jack_port_t *snk = jack_port_by_id(host->jclient, b);
+	if(!src || !snk || !jack_port_is_mine(host->jclient, snk))
+		return;
+	const char *source = jack_port_name(src);
+	const char *sink = jack_port_name(snk);
+	if(!source || !sink)
+		return;
+
+	for (unsigned c = 0; c < host->n; c++)
+		audio_jack_disconnect(&host->ctx[c]->audio, source, sink);
+}
+
+/* ports and clients coming and going- the contexts whose patterns match rescan on the main loop */
+static void host_port_cb(jack_port_id_t id, int reg, void *arg){
+	struct host * host = (struct host *)arg;
+	jack_port_t * p = jack_port_by_id(host->jclient, id);
+	const char * name;
+	if(!p || jack_port_is_mine(host->jclient, p) || !((name = jack_port_name(p))))
+		return;
+	int flags = jack_port_flags(p);
+	for (unsigned c = 0; c < host->n; c++)
+		audio_jack_port(&host->ctx[c]->audio, name, flags, reg);
+}
+
+static void host_client_cb(const char * name, int reg, void *arg){
+	struct host * host = (struct host *)arg;
+	debug(&host->ctx[0]->audio, "Client %s %s\n", name, reg ? "registered" : "gone");
+	if(!reg)
+		for (unsigned c = 0; c < host->n; c++)
+			audio_jack_client_gone(&host->ctx[c]->audio);
+}
+
+static void host_shutdown(void *arg) {
+	(void)arg;
+	exit (EXIT_FAILURE);
+}
+
+/* open the jack client, set up every context in it, then start the callbacks and connect */
+int host_init(struct host * host){
+	struct audio * first = &host->ctx[0]->audio;
+
+	/* open a client connection to the JACK server */
+	jack_status_t status;
+	if(!((host->jclient = jack_client_open(host->name, JackNoStartServer, &status, host->server)))) {
+		debug(first, "jack_client_open() failed, status = 0x%2.0x\n", status);
+		if (status & JackServerFailed)
+			fprintf (stderr, "Unable to connect to JACK server\n");
+		return 1;
+	}
+
+	if(status & JackNameNotUnique){
+		char * name = jack_get_client_name(host->jclient);
+		for (unsigned c = 0; c < host->n; c++)
+			if(host->ctx[c]->audio.name == host->name) /* single config- named after the client */
+				host->ctx[c]->audio.name = name;
+		host->name = name;
+	}
+	host->samplerate = jack_get_sample_rate(host->jclient);
+
+	/* profile the callback at the shortest interval asked for */
+	unsigned profile = 0;
+	for (unsigned c = 0; c < host->n; c++){
+		unsigned p = host->ctx[c]->audio.profile;
+		if(p && (!profile || p < profile))
+			profile = p;
+	}
+	if(profile){
+		if(!((host->prof = prof_init(profile, host->samplerate))))
+			return 1;
+		jack_set_xrun_callback(host->jclient, host_xrun, (void *)host);
+	}
+
+	for (unsigned c = 0; c < host->n; c++){
+		struct host_ctx * ctx = host->ctx[c];
+		if(audio_init(&ctx->audio, host))
+			return 1;
+		monitor_init(&ctx->audio, &ctx->mon);
+		if(host->n > 1)
+			debug(&ctx->audio, "Context from %s, %u channels\n", ctx->audio.config, ctx->audio.channels);
+	}
+
+	if(action_start())
+		return 1;
+
+	/* start jack callbacks */
+	jack_set_process_callback (host->jclient, host_process, (void *)host);
+	jack_set_port_connect_callback(host->jclient, host_connect_cb, (void *)host);
+	jack_set_port_registration_callback(host->jclient, host_port_cb, (void *)host);
+	jack_set_client_registration_callback(host->jclient, host_client_cb, (void *)host);
+	jack_on_shutdown (host->jclient, host_shutdown, 0);
+	if (jack_activate (host->jclient)) {
+		perror("cannot activate client");
+		return 1;
+	}
+	host->jack_activated = true;
+
+	/* make the connections, and rescan once on the first poll for ports that came before the callbacks were set */
+	for (unsigned c = 0; c < host->n; c++){
+		jack_connect_source_ports(&host->ctx[c]->audio);
+		host->ctx[c]->audio.resync = true;
+	}
+	return 0;
+}
+
+/* ms until ts, 0 if passed */
+static long ms_until(const struct timespec * ts, const struct timespec * now){
+	long ms = (ts->tv_sec - now->tv_sec)*1000 + (ts->tv_nsec - now->tv_nsec)/1000000L;
+	return ms > 0 ? ms : 0;
+}
+
+/* wait for a wake up from any context, or the next periodic poll. Then run every context that
+ * woke or is due. Each polls at its VU rate, or a prime number reasonable amount.
+ * return -1 and errno set on error */
+int host_poll(struct host * host){
+	struct pollfd pfd[host->n];
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	long ms = -1;
+	for (unsigned c = 0; c < host->n; c++){
+		struct host_ctx * ctx = host->ctx[c];
+		pfd[c].fd = ctx->audio.h_wake;
+		pfd[c].events = POLLIN;
+		long t = ms_until(&ctx->_poll, &now);
+		if(ms < 0 || t < ms)
+			ms = t;
+	}
+
+	int ret = poll(pfd, host->n, ms);
+	if(ret < 0)
+		return errno == EINTR ? 0 : -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (unsigned c = 0; c < host->n; c++){
+		struct host_ctx * ctx = host->ctx[c];
+		struct audio * audio = &ctx->audio;
+		if(!(pfd[c].revents & POLLIN) && ms_until(&ctx->_poll, &now))
+			continue;
+
+		audio_poll(audio);
+		monitor_run(audio, &ctx->mon, audio_now(audio));
+		if(audio->resync || audio->_sinks_changed) /* ports came or went */
+			jack_check_ports(audio);
+
+		unsigned period = audio->vu_ms ?: 1457;
+		if(audio->resync)
+			period = 1; /* swap the bank as soon as the last one retires */
+		set_timer(&ctx->_poll, period);
+	}
+	gpio_flush(); /* all contexts GPIO changes together */
+	if(host->prof)
+		prof_poll(host->prof, jack_cpu_load(host->jclient));
+	return 0;
+}
+
+void host_print_stats(struct host * host, FILE * fp){
+	for (unsigned c = 0; c < host->n; c++)
+		monitor_print_stats(&host->ctx[c]->audio, &host->ctx[c]->mon, fp);
+	action_print_stats(fp);
+	if(host->prof)
+		prof_print(host->prof, jack_cpu_load(host->jclient), fp);
+}
+
+void host_close(struct host * host){
+	jack_client_close(host->jclient); /* stop processing before unmapping */
+	for (unsigned c = 0; c < host->n; c++){
+		audio_stop(&host->ctx[c]->audio);
+		fifo_close(host->ctx[c]->audio.h_vu_pipe);
+		vushm_close(&host->ctx[c]->audio);
+	}
+}
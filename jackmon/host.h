@@ -0,0 +1,40 @@
+/*
+ * host.h
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include "audio.h"
+#include "monitor.h"
+#include "prof.h"
+
+/* a monitor context- one config file, with its own sources, channel bank and actions */
+struct host_ctx {
+	struct audio audio;
+	struct monitor mon;
+	struct timespec _poll; /* next periodic poll of this context */
+};
+
+/* one jack client and process callback shared by every context */
+struct host {
+	char * name; /* jack client name */
+	char * server;
+	jack_client_t * jclient;
+	ftype samplerate;
+	struct host_ctx ** ctx;
+	unsigned n;
+	uint64_t frame; /* realtime thread- sample clock extended from the 32 bit jack frame time */
+	bool started;
+	bool jack_activated; /* flag that client is active */
+	struct prof * prof; /* process callback profiler- NULL unless a context sets profile */
+};
+
+int host_init(struct host * host);
+int host_poll(struct host * host);
+void host_print_stats(struct host * host, FILE * fp);
+void host_close(struct host * host);
+
+#endif /* HOST_H_ */
@@ -0,0 +1,344 @@
+/*
+ * jackstub.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * In process stand in for the jack server, for tests- see jackstub.h. Only the calls jackmon makes are here.
+ * Ports are never reused, so a port id is its index for the whole run.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <jack/thread.h>
+
+#include "jackstub.h"
+
+#define MAX_PORTS 256
+
+struct _jack_port {
+	char name[128];
+	unsigned long flags;
+	bool live;
+	bool mine; /* registered by the client */
+	float amp; /* sine on an output of another client */
+	unsigned clip; /* samples at full scale at the start of the next cycle */
+	float buf[JACKSTUB_FRAMES];
+};
+
+struct _jack_client {
+	char name[64];
+	bool active;
+	JackProcessCallback process;
+	void * process_arg;
+	JackPortConnectCallback connect;
+	void * connect_arg;
+	JackPortRegistrationCallback reg;
+	void * reg_arg;
+	JackClientRegistrationCallback client_reg;
+	void * client_reg_arg;
+};
+
+static struct _jack_client client;
+static struct _jack_port ports[MAX_PORTS];
+static unsigned n_ports;
+static bool conn[MAX_PORTS][MAX_PORTS]; /* [source][destination] */
+static float silence[JACKSTUB_FRAMES];
+static jack_nframes_t frames;
+static unsigned long cycles;
+
+static int find(const char * name){
+	for(unsigned i = 0; i < n_ports; i++)
+		if(ports[i].live && !strcmp(ports[i].name, name))
+			return i;
+	return -1;
+}
+
+/* drop every connection to or from port i */
+static void disconnect_all(unsigned i){
+	for(unsigned j = 0; j < n_ports; j++){
+		for(unsigned k = 0; k < 2; k++){
+			unsigned s = k ? j : i, d = k ? i : j;
+			if(!conn[s][d])
+				continue;
+			conn[s][d] = false;
+			if(client.connect)
+				client.connect(s, d, 0, client.connect_arg);
+		}
+	}
+}
+
+static int add(const char * name, unsigned long flags, bool mine){
+	if(n_ports >= MAX_PORTS || find(name) >= 0)
+		return -1;
+	unsigned i = n_ports++;
+	struct _jack_port * p = &ports[i];
+	snprintf(p->name, sizeof(p->name), "%s", name);
+	p->flags = flags;
+	p->live = true;
+	p->mine = mine;
+	if(client.active && client.reg)
+		client.reg(i, 1, client.reg_arg);
+	return i;
+}
+
+/* unregister port i, its connections first */
+static void remove_port(unsigned i){
+	disconnect_all(i);
+	ports[i].live = false;
+	if(client.active && client.reg)
+		client.reg(i, 0, client.reg_arg);
+}
+
+int jackstub_add(const char * name, unsigned long flags){
+	return add(name, flags, false) < 0;
+}
+
+void jackstub_remove(const char * name){
+	int i = find(name);
+	if(i < 0)
+		return;
+	remove_port(i);
+}
+
+void jackstub_signal(const char * name, float amp, unsigned clip){
+	int i = find(name);
+	if(i < 0)
+		return;
+	ports[i].amp = amp;
+	ports[i].clip = clip;
+}
+
+void jackstub_cycle(void){
+	for(unsigned i = 0; i < n_ports; i++){
+		struct _jack_port * p = &ports[i];
+		if(!p->live || p->mine || !(p->flags & JackPortIsOutput))
+			continue;
+		for(unsigned k = 0; k < JACKSTUB_FRAMES; k++)
+			p->buf[k] = k < p->clip ? 1.0f : p->amp * sinf(2.0f * (float)M_PI * 1000.0f * (frames + k) / JACKSTUB_RATE);
+		p->clip = 0;
+	}
+	if(client.active && client.process)
+		client.process(JACKSTUB_FRAMES, client.process_arg);
+	frames += JACKSTUB_FRAMES;
+	cycles++;
+}
+
+unsigned long jackstub_cycles(void){
+	return cycles;
+}
+
+bool jackstub_exists(const char * name){
+	return find(name) >= 0;
+}
+
+bool jackstub_connected(const char * src, const char * dst){
+	int s = find(src), d = find(dst);
+	return s >= 0 && d >= 0 && conn[s][d];
+}
+
+unsigned jackstub_connections(const char * name){
+	int i = find(name);
+	unsigned n = 0;
+	for(unsigned j = 0; i >= 0 && j < n_ports; j++)
+		n += conn[i][j] + conn[j][i];
+	return n;
+}
+
+jack_client_t * jack_client_open(const char * name, jack_options_t options, jack_status_t * status, ...){
+	(void)options;
+	snprintf(client.name, sizeof(client.name), "%s", name);
+	*status = 0;
+	return &client;
+}
+
+int jack_client_close(jack_client_t * c){
+	c->active = false;
+	return 0;
+}
+
+char * jack_get_client_name(jack_client_t * c){
+	return c->name;
+}
+
+jack_nframes_t jack_get_sample_rate(jack_client_t * c){
+	(void)c;
+	return JACKSTUB_RATE;
+}
+
+/* ports matching the extended regex and flags, as a NULL terminated array for jack_free(). NULL if none */
+const char ** jack_get_ports(jack_client_t * c, const char * port_name_pattern, const char * type_name_pattern,
+		unsigned long flags){
+	(void)c;
+	(void)type_name_pattern;
+	regex_t re;
+	if(!port_name_pattern || regcomp(&re, port_name_pattern, REG_EXTENDED | REG_NOSUB))
+		return NULL;
+	const char ** list = calloc(n_ports + 1, sizeof(char *));
+	unsigned n = 0;
+	for(unsigned i = 0; list && i < n_ports; i++)
+		if(ports[i].live && (ports[i].flags & flags) == flags && !regexec(&re, ports[i].name, 0, NULL, 0))
+			list[n++] = ports[i].name;
+	regfree(&re);
+	if(!n){
+		free(list);
+		return NULL;
+	}
+	return list;
+}
+
+void jack_free(void * ptr){
+	free(ptr);
+}
+
+jack_port_t * jack_port_register(jack_client_t * c, const char * port_name, const char * port_type, unsigned long flags,
+		unsigned long buffer_size){
+	(void)port_type;
+	(void)buffer_size;
+	char name[128];
+	snprintf(name, sizeof(name), "%s:%s", c->name, port_name);
+	int i = add(name, flags, true);
+	return i < 0 ? NULL : &ports[i];
+}
+
+int jack_port_unregister(jack_client_t * c, jack_port_t * port){
+	(void)c;
+	if(!port->live)
+		return -1;
+	remove_port(port - ports);
+	return 0;
+}
+
+/* an input of ours reads the first source connected to it */
+void * jack_port_get_buffer(jack_port_t * port, jack_nframes_t nframes){
+	(void)nframes;
+	unsigned d = port - ports;
+	if(!port->live)
+		abort(); /* a bank still running a port it unregistered */
+	if(port->flags & JackPortIsOutput)
+		return port->buf;
+	for(unsigned s = 0; s < n_ports; s++)
+		if(conn[s][d])
+			return ports[s].buf;
+	return silence;
+}
+
+jack_port_t * jack_port_by_id(jack_client_t * c, jack_port_id_t port_id){
+	(void)c;
+	return port_id < n_ports ? &ports[port_id] : NULL;
+}
+
+const char * jack_port_name(const jack_port_t * port){
+	return port->name;
+}
+
+int jack_port_flags(const jack_port_t * port){
+	return port->flags;
+}
+
+int jack_port_is_mine(const jack_client_t * c, const jack_port_t * port){
+	(void)c;
+	return port->mine;
+}
+
+int jack_set_process_callback(jack_client_t * c, JackProcessCallback process_callback, void * arg){
+	c->process = process_callback;
+	c->process_arg = arg;
+	return 0;
+}
+
+int jack_set_xrun_callback(jack_client_t * c, JackXRunCallback xrun_callback, void * arg){
+	(void)c;
+	(void)xrun_callback;
+	(void)arg;
+	return 0;
+}
+
+int jack_set_port_connect_callback(jack_client_t * c, JackPortConnectCallback connect_callback, void * arg){
+	c->connect = connect_callback;
+	c->connect_arg = arg;
+	return 0;
+}
+
+int jack_set_port_registration_callback(jack_client_t * c, JackPortRegistrationCallback registration_callback, void * arg){
+	c->reg = registration_callback;
+	c->reg_arg = arg;
+	return 0;
+}
+
+/* stored only- no other client comes or goes */
+int jack_set_client_registration_callback(jack_client_t * c, JackClientRegistrationCallback registration_callback,
+		void * arg){
+	c->client_reg = registration_callback;
+	c->client_reg_arg = arg;
+	return 0;
+}
+
+void jack_on_shutdown(jack_client_t * c, JackShutdownCallback function, void * arg){
+	(void)c;
+	(void)function;
+	(void)arg;
+}
+
+/* not a realtime server- threads asked for one under it get normal scheduling */
+int jack_client_real_time_priority(jack_client_t * c){
+	(void)c;
+	return -1;
+}
+
+int jack_client_create_thread(jack_client_t * c, jack_native_thread_t * thread, int priority, int realtime,
+		void *(*start_routine)(void *), void * arg){
+	(void)c;
+	(void)priority;
+	(void)realtime;
+	return pthread_create(thread, NULL, start_routine, arg);
+}
+
+int jack_activate(jack_client_t * c){
+	c->active = true;
+	return 0;
+}
+
+int jack_connect(jack_client_t * c, const char * source_port, const char * destination_port){
+	(void)c;
+	int s = find(source_port), d = find(destination_port);
+	if(s < 0 || d < 0)
+		return -1;
+	if(conn[s][d])
+		return EEXIST;
+	conn[s][d] = true;
+	if(client.connect)
+		client.connect(s, d, 1, client.connect_arg);
+	return 0;
+}
+
+int jack_disconnect(jack_client_t * c, const char * source_port, const char * destination_port){
+	(void)c;
+	int s = find(source_port), d = find(destination_port);
+	if(s < 0 || d < 0 || !conn[s][d])
+		return -1;
+	conn[s][d] = false;
+	if(client.connect)
+		client.connect(s, d, 0, client.connect_arg);
+	return 0;
+}
+
+jack_nframes_t jack_frame_time(const jack_client_t * c){
+	(void)c;
+	return frames;
+}
+
+jack_nframes_t jack_last_frame_time(const jack_client_t * c){
+	(void)c;
+	return frames;
+}
+
+float jack_cpu_load(jack_client_t * c){
+	(void)c;
+	return 0.0f;
+}
@@ -0,0 +1,34 @@
+/*
+ * jackstub.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * In process stand in for the jack server, for tests- links in place of libjack. One client, with the process
+ * callback run only when the test asks, and the callbacks for ports coming and going run inline.
+ */
+
+#ifndef JACKSTUB_H_
+#define JACKSTUB_H_
+
+#include <stdbool.h>
+#include <jack/jack.h>
+
+#define JACKSTUB_FRAMES 256 /* per process cycle */
+#define JACKSTUB_RATE 48000
+
+/* add a port of another client, eg "sys:capture_1" with JackPortIsOutput- the registration callback runs once active */
+int jackstub_add(const char * name, unsigned long flags);
+/* remove one- its connections go first, each with the connect callback, then the registration callback */
+void jackstub_remove(const char * name);
+/* set a ports signal- a sine of amplitude amp, with the first clip samples of the next cycle at full scale */
+void jackstub_signal(const char * name, float amp, unsigned clip);
+/* run one process cycle */
+void jackstub_cycle(void);
+/* cycles run so far */
+unsigned long jackstub_cycles(void);
+bool jackstub_exists(const char * name);
+bool jackstub_connected(const char * src, const char * dst);
+/* connections to or from a port */
+unsigned jackstub_connections(const char * name);
+
+#endif /* JACKSTUB_H_ */
@@ -0,0 +1,132 @@
+/*
+ * loudness.c
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: chris
+ *
+ * Main loop side of the loudness meter- gating and integration of the realtime thread's 100ms blocks. See loudness.h
+ */
+
+#define _GNU_SOURCE
+#include <math.h>
+
+#include "loudness.h"
+
+static double lufs(double ms){
+	return ms > 0.0 ? -0.691 + 10.0 * log10(ms) : -INFINITY;
+}
+
+/* first bin at or over loudness l */
+static unsigned hist_bin(double l){
+	if(l <= LOUD_HIST_MIN)
+		return 0;
+	double b = ceil((l - LOUD_HIST_MIN) / LOUD_HIST_STEP - 1e-9);
+	return b < LOUD_HIST_BINS ? (unsigned)b : LOUD_HIST_BINS;
+}
+
+static void loud_hist_add(struct loud_hist * h, double ms){
+	double l = lufs(ms);
+	if(l < LOUD_HIST_MIN) /* absolute gate */
+		return;
+	unsigned b = (l - LOUD_HIST_MIN) / LOUD_HIST_STEP;
+	if(b >= LOUD_HIST_BINS)
+		b = LOUD_HIST_BINS - 1;
+	h->n[b]++;
+	h->ms[b] += ms;
+}
+
+/* count and mean square from bin 'from' up */
+static unsigned long loud_hist_sum(const struct loud_hist * h, unsigned from, double * ms){
+	unsigned long n = 0;
+	double sum = 0.0;
+	for(unsigned b = from; b < LOUD_HIST_BINS; b++){
+		n += h->n[b];
+		sum += h->ms[b];
+	}
+	*ms = n ? sum / n : 0.0;
+	return n;
+}
+
+/* first bin over the relative gate, gate LU below the mean of everything over the absolute gate */
+static unsigned loud_hist_gate(const struct loud_hist * h, double gate){
+	double ms;
+	if(!loud_hist_sum(h, 0, &ms))
+		return LOUD_HIST_BINS;
+	return hist_bin(lufs(ms) + gate);
+}
+
+/* BS.1770 integrated- mean of the gating blocks over the -10LU relative gate */
+static float integrated(const struct loud_hist * h){
+	double ms;
+	if(!loud_hist_sum(h, loud_hist_gate(h, -10.0), &ms))
+		return -INFINITY;
+	return lufs(ms);
+}
+
+/* EBU Tech 3342 range- 10th to 95th percentile of the short term values over the -20LU relative gate */
+static float range(const struct loud_hist * h){
+	double ms;
+	unsigned from = loud_hist_gate(h, -20.0);
+	unsigned long n = loud_hist_sum(h, from, &ms), lo = n * 10 / 100, hi = n * 95 / 100, c = 0;
+	if(!n)
+		return -INFINITY;
+	double l10 = 0.0, l95 = 0.0;
+	for(unsigned b = from; b < LOUD_HIST_BINS; b++){
+		if(c <= lo && c + h->n[b] > lo)
+			l10 = LOUD_HIST_MIN + (b + 0.5) * LOUD_HIST_STEP;
+		if(c <= hi && c + h->n[b] > hi){
+			l95 = LOUD_HIST_MIN + (b + 0.5) * LOUD_HIST_STEP;
+			break;
+		}
+		c += h->n[b];
+	}
+	return l95 - l10;
+}
+
+struct loudness * loudness_init(void){
+	struct loudness * l = aligned_calloc(1, sizeof(struct loudness));
+	if(l)
+		l->val.m = l->val.s = l->val.i = l->val.lra = -INFINITY;
+	return l;
+}
+
+/* mean square of the last n blocks */
+static double recent(const struct loudness * l, unsigned n){
+	double sum = 0.0;
+	for(unsigned k = 1; k <= n; k++)
+		sum += l->_recent[(l->blocks - k) % LOUD_SHORT];
+	return sum / n;
+}
+
+/* take the blocks since last time, and update the values */
+void loudness_poll(struct loudness * l){
+	unsigned tail = atomic_load_explicit(&l->tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(&l->head, memory_order_acquire);
+	if(tail == head)
+		return;
+	for(; tail != head; tail++){
+		l->_recent[l->blocks++ % LOUD_SHORT] = l->block[tail % LOUD_RING];
+		if(l->blocks >= LOUD_MOMENTARY){
+			double ms = recent(l, LOUD_MOMENTARY);
+			l->val.m = lufs(ms);
+			loud_hist_add(&l->gating, ms);
+		}
+		if(l->blocks >= LOUD_SHORT){
+			double ms = recent(l, LOUD_SHORT);
+			l->val.s = lufs(ms);
+			loud_hist_add(&l->range, ms);
+		}
+	}
+	atomic_store_explicit(&l->tail, tail, memory_order_release);
+	l->val.i = integrated(&l->gating);
+	l->val.lra = range(&l->range);
+}
+
+void loudness_print(struct loudness * l, const char * prefix, FILE * fp){
+	fprintf(fp, "%sloudness M %0.1f S %0.1f I %0.1f LUFS, LRA %0.1f LU over %0.1fs",
+			prefix, l->val.m, l->val.s, l->val.i, l->val.lra, l->blocks / 10.0);
+	unsigned dropped = atomic_load_explicit(&l->dropped, memory_order_relaxed);
+	if(dropped)
+		fprintf(fp, ", %u blocks dropped", dropped);
+	fprintf(fp, "\n");
+}
@@ -0,0 +1,73 @@
+/*
+ * loudness.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: chris
+ *
+ * EBU R128 / ITU-R BS.1770 loudness, loudness = 1 in the config. The realtime thread K-weights each channel
+ * (see struct loud in dsp.h) and queues the channel sum of each 100ms block's mean square here.
+ * The main loop turns them into momentary (400ms), short term (3s) and gated integrated loudness, and
+ * loudness range per EBU Tech 3342. Integration keeps histograms rather than blocks, so memory is fixed
+ * however long it runs. All channels are weighted 1.0- there is no layout to find surrounds from.
+ */
+
+#ifndef LOUDNESS_H_
+#define LOUDNESS_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "utils.h"
+
+#define LOUD_RING 64 /* 100ms blocks- 6.4s for the main loop to take them */
+#define LOUD_SHORT 30 /* blocks in the 3s short term window */
+#define LOUD_MOMENTARY 4 /* and the 400ms momentary window, which is also the gating block */
+#define LOUD_HIST_MIN -70.0 /* absolute gate, LUFS */
+#define LOUD_HIST_STEP 0.1 /* LU per histogram bin */
+#define LOUD_HIST_BINS 800 /* up to +10 LUFS */
+
+/* gated values by loudness- count and total mean square in each bin, so gated means are exact */
+struct loud_hist {
+	unsigned long n[LOUD_HIST_BINS];
+	double ms[LOUD_HIST_BINS];
+};
+
+/* LUFS, and LU for the range. -INFINITY until there is enough audio */
+struct loud_val {
+	float m; /* momentary */
+	float s; /* short term */
+	float i; /* integrated */
+	float lra; /* loudness range */
+};
+
+struct loudness {
+	/* single producer (realtime thread), single consumer (main loop) ring of block mean squares */
+	_Alignas(CACHELINE) atomic_uint head;
+	atomic_uint dropped;
+	_Alignas(CACHELINE) atomic_uint tail;
+	float block[LOUD_RING];
+	/* main loop only */
+	_Alignas(CACHELINE) double _recent[LOUD_SHORT]; /* last 3s of blocks */
+	uint64_t blocks; /* taken so far */
+	struct loud_hist gating; /* 400ms blocks every 100ms, for integrated */
+	struct loud_hist range; /* 3s short term every 100ms, for the range */
+	struct loud_val val; /* as of the last loudness_poll() */
+};
+
+/* realtime thread- queue a 100ms block. Full drops it */
+static inline void loudness_put(struct loudness * l, float ms){
+	unsigned head = atomic_load_explicit(&l->head, memory_order_relaxed);
+	if(head - atomic_load_explicit(&l->tail, memory_order_acquire) >= LOUD_RING){
+		atomic_fetch_add_explicit(&l->dropped, 1, memory_order_relaxed);
+		return;
+	}
+	l->block[head % LOUD_RING] = ms;
+	atomic_store_explicit(&l->head, head + 1, memory_order_release);
+}
+
+struct loudness * loudness_init(void);
+void loudness_poll(struct loudness * l);
+void loudness_print(struct loudness * l, const char * prefix, FILE * fp);
+
+#endif /* LOUDNESS_H_ */
@@ -0,0 +1,328 @@
+/*
+ * monitor.c
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "monitor.h"
+
+void monitor_init(struct audio * audio, struct monitor * m){
+	memset(m, 0, sizeof(*m)); /* timers, event times and histograms */
+	m->threshold_set = -1; /* init */
+	m->clip_set = -1;
+
+	/* scripts run on the action executor thread */
+	action_init(&m->clip_act, audio->clip_cmd, "CLIP", 100);
+	action_init(&m->level_act, audio->level_cmd, "TRIG", 500);
+	m->clip_act.name = m->level_act.name = audio->name;
+	m->clip_act.debug = m->level_act.debug = audio->debug;
+	m->clip_act.dedupe = audio->clip_ms; /* one shot clip_cmd only ever posts 1 */
+	m->level_act.dedupe = true;
+}
+
+/* add the time since sample clock frame at, to the now. Offline there is no now */
+static void lat_add(struct audio * audio, struct hist * h, uint64_t at){
+	if(!audio->offline)
+		hist_add(h, frames_to_ns(at, audio_now(audio), audio->samplerate));
+}
+
+/* monotonic time of sample clock frame at, for actions timed on the executor thread */
+static void frame_time(struct audio * audio, uint64_t at, struct timespec * ts){
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	uint64_t ns = timespec_ns(ts) - frames_to_ns(at, audio_now(audio), audio->samplerate);
+	ts->tv_sec = ns / 1000000000ULL;
+	ts->tv_nsec = ns % 1000000000ULL;
+}
+
+/* connect or disconnect each channels source to its level sink. The sink goes by the channels port number, so a
+ * channel keeps its sink while its source is there, and one that went can't leave its connection on another */
+static void monitor_connect_sinks(struct audio * audio, bool on){
+	const struct audio_bank * b = atomic_load_explicit(&audio->bank, memory_order_relaxed);
+	unsigned sinks = 0;
+	if(!audio->_level_sink_ports || audio->level_gate) /* the gate switches them, connected for good */
+		return;
+	while(audio->_level_sink_ports[sinks])
+		sinks++;
+	for(unsigned i = 0; i < b->channels; i++){
+		if(!b->port[i] || b->port[i] > sinks)
+			continue;
+		const char * src = b->sources[i], * snk = audio->_level_sink_ports[b->port[i] - 1];
+		if(on && !jack_connect(audio->jclient, src, snk))
+			debug(audio, "connect %s to %s\n", src, snk);
+		else if(!on && !jack_disconnect(audio->jclient, src, snk))
+			debug(audio, "disconnect %s from %s\n", src, snk);
+	}
+}
+
+/* take the realtime events- track which channels have the level on from its edges,
+ * and keep the first onset and clip for timing the actions they cause */
+static void monitor_events(struct audio * audio, struct monitor * m, uint64_t now){
+	struct audio_event ev;
+	while(audio_event_get(audio, &ev)){
+		uint64_t at = ev.frame + ev.offset;
+		struct chan * c = &audio->chan[ev.chan];
+		if(!audio->offline)
+			hist_add(&m->lat_wake, frames_to_ns(at, now, audio->samplerate));
+		switch(ev.type){
+		case AUDIO_EVENT_LEVEL:
+			if(!c->level){
+				c->level = true;
+				m->_levels++;
+			}
+			if(m->threshold_set != 1 && !m->_onset)
+				m->_onset = at;
+			break;
+		case AUDIO_EVENT_RELEASE:
+			if(c->level){
+				c->level = false;
+				if(!--m->_levels)
+					m->_release = at;
+			}
+			break;
+		case AUDIO_EVENT_CLIP:
+			if(!m->_clip_at)
+				m->_clip_at = at;
+			break;
+		}
+	}
+
+	/* lost some, or the channels changed- go by the levels now */
+	unsigned dropped = atomic_load_explicit(&audio->events->dropped, memory_order_relaxed);
+	if((dropped != m->_dropped || audio->ports_changed != m->_ports_changed) && audio->level_sec){
+		unsigned levels = m->_levels;
+		m->_levels = 0;
+		for(unsigned i = 0; i < audio->channels; i++){
+			struct chan * c = &audio->chan[i];
+			c->level = (audio->level_window_ms ? c->win_val : c->rms_val) >= audio->level_release;
+			m->_levels += c->level;
+		}
+		if(levels && !m->_levels)
+			m->_release = now;
+	}
+	if(audio->ports_changed != m->_ports_changed && m->threshold_set == 1)
+		monitor_connect_sinks(audio, true); /* new channels join the triggered ones */
+	m->_dropped = dropped;
+	m->_ports_changed = audio->ports_changed;
+}
+
+/* offline we only report state changes in the event stream- nothing is actioned */
+static void monitor_event(struct audio * audio, uint64_t now, const char * fmt, ...){
+	va_list args;
+	printf("@%0.3f ", now / audio->samplerate);
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end (args);
+	printf("\n");
+}
+
+/* act on the latest channel snapshots from audio_poll(). now is the sample clock from audio_now() */
+void monitor_run(struct audio * audio, struct monitor * m, uint64_t now){
+	ftype trigger_level=0;
+	bool clip = false;
+	struct timespec origin;
+
+	monitor_events(audio, m, now);
+	if(audio->loud)
+		loudness_poll(audio->loud);
+
+	/* keep trying to set up GPIOs- this might take some time on boot after exporting */
+	if(!audio->offline){
+		if(audio->clip_gpio.gpio && !audio->clip_gpio.initialised)
+			gpio_init(&audio->clip_gpio);
+		if(audio->level_gpio.gpio && !audio->level_gpio.initialised)
+			gpio_init(&audio->level_gpio);
+	}
+
+	bool vu_valid=false;
+	if(audio->vu_ms){
+		for (unsigned i=0; i < audio->channels; i++){
+			struct chan * c = &audio->chan[i];
+			if((min_level < c->rms_val || min_level < c->peak_val)){
+				vu_valid=m->vu_printing=true;
+			}
+		}
+	}
+
+	for (unsigned i=0; i < audio->channels; i++){
+		struct chan * c = &audio->chan[i];
+		if(m->vu_printing && !audio->vu_format){ /* always print all channels */
+			if(!audio->vu_pretty)
+				vu_print(audio, "%0.1f %0.1f ", 20*flog(c->rms_val), 20*flog(c->peak_val));
+			else
+				vu_print_pretty(audio, 20*flog(c->rms_val), 20*flog(c->peak_val), i);
+		}
+
+		if(c->clip_event) {
+			clip = true;
+			//debug(audio, "ch %d clip\n", i+1);
+			c->clip_event = false;
+		}
+
+		/* loudest channel with the level on, to report */
+		ftype l = audio->level_window_ms ? c->win_val : c->rms_val;
+		if(c->level && l > trigger_level)
+			trigger_level = l;
+	}
+	if(m->vu_printing && audio->loud && !audio->vu_format){
+		struct loud_val * v = &audio->loud->val;
+		if(!audio->vu_pretty)
+			vu_print(audio, "M %0.1f S %0.1f I %0.1f LRA %0.1f", v->m, v->s, v->i, v->lra);
+		else
+			vu_print(audio, "\n\r\x1b[2KM %0.1f S %0.1f I %0.1f LUFS LRA %0.1f LU", v->m, v->s, v->i, v->lra);
+	}
+	if(m->vu_printing && audio->spectrum && !audio->vu_format && !audio->vu_pretty){
+		float level[BANDS_MAX_CHANNELS * BANDS_MAX];
+		uint64_t periods;
+		unsigned channels = bands_get(audio->spectrum, level, &periods);
+		vu_print(audio, audio->loud ? " B" : "B");
+		for(unsigned i = 0; i < channels * audio->bands; i++)
+			vu_print(audio, " %0.1f", 20*flog(level[i]));
+	}
+	if(m->vu_printing){
+		if(audio->vu_format)
+			vu_write_frame(audio, now, (clip ? VU_FLAG_CLIP : 0) | (m->threshold_set == 1 ? VU_FLAG_TRIG : 0));
+		else if(!audio->vu_pretty)
+			vu_print(audio, "\n");
+		if(!vu_valid)
+			m->vu_printing = false;
+	}
+
+	if(audio->disconnected){ /* reset script timers so we turn stuff off immediately */
+		m->_clip_hold = 0;
+		m->_level_hold = 0;
+	}
+	/* clip */
+	if(audio->clip_en){
+		if(clip && !audio->disconnected){
+			uint64_t at = m->_clip_at ?: now;
+			m->_clip_at = 0;
+			set_ftimer(&m->_clip_hold, now, ms_to_frames(audio->clip_ms?:200, audio->samplerate)); /* always set timer to limit calls */
+			if(!audio->offline)
+				frame_time(audio, at, &origin);
+			if(m->clip_set < 1){
+				m->clip_set = 1;
+				if(audio->offline)
+					monitor_event(audio, at, "CLIP=1");
+				else {
+					action_post_at(&m->clip_act, 1, &origin);
+					if(audio->clip_gpio.gpio){
+						gpio_set(&audio->clip_gpio, true);
+						lat_add(audio, &m->lat_clip_gpio, at);
+					}
+				}
+			} else if (audio->clip_cmd && !audio->clip_ms && !audio->offline)
+				action_post_at(&m->clip_act, -1, &origin); /* one shot- no args */
+		} else if (!ftimer_poll(&m->_clip_hold, now) && m->clip_set){
+			if(audio->offline){
+				if(m->clip_set == 1)
+					monitor_event(audio, now, "CLIP=0");
+			} else if (audio->clip_ms){
+				action_post(&m->clip_act, 0);
+				gpio_set(&audio->clip_gpio, false);
+			}
+			m->clip_set = 0;
+		}
+	}
+
+	/* level trigger- on from the first onset, held for level_sec after the last channel on releases.
+	 * An onset and release between wake ups still triggers */
+	uint64_t hold = ms_to_frames(audio->level_sec*1000ULL, audio->samplerate);
+	if(m->_release){
+		if(!m->_levels)
+			set_ftimer(&m->_level_hold, m->_release, hold);
+		m->_release = 0;
+	}
+	if(audio->level_sec && (m->_levels || m->_onset) && !audio->disconnected){
+		if(m->_levels)
+			set_ftimer(&m->_level_hold, now, hold);
+		if(!trigger_level)
+			trigger_level = audio->level_thres; /* already dropped back */
+		if(m->threshold_set < 1){
+			uint64_t onset = m->_onset ?: now;
+			m->_onset = 0;
+			debug(audio, "Level triggered %0.1fdB\n", 20*flog(trigger_level));
+			m->threshold_set = 1;
+			if(audio->offline){
+				monitor_event(audio, onset, "TRIG=1 %0.1f", 20*flog(trigger_level));
+				return;
+			}
+			frame_time(audio, onset, &origin);
+
+			/* GPIO first and flushed now- its usually the amp */
+			if(audio->level_gpio.gpio) {
+				debug(audio, "GPIO %d on\n", abs(audio->level_gpio.gpio));
+				gpio_set(&audio->level_gpio, true);
+				gpio_flush();
+				lat_add(audio, &m->lat_gpio, onset);
+			}
+
+			/* run script */
+			action_post_at(&m->level_act, 1, &origin);
+
+			if(audio->_level_sink_ports && !audio->level_gate){
+				monitor_connect_sinks(audio, true);
+				lat_add(audio, &m->lat_connect, onset);
+			}
+		}
+	} else if (audio->level_sec && !ftimer_poll(&m->_level_hold, now) && m->threshold_set){ /* -1 (starting) or 1 */
+		debug(audio, "Trigger %s\n", m->threshold_set == 1 ? "expired" : "reset");
+		if(audio->offline){
+			if(m->threshold_set == 1)
+				monitor_event(audio, now, "TRIG=0");
+			m->threshold_set = 0;
+			return;
+		}
+		m->threshold_set = 0;
+		monitor_connect_sinks(audio, false);
+
+		/* run script */
+		action_post(&m->level_act, 0);
+
+		/* GPIO */
+		if(audio->level_gpio.gpio){
+			debug(audio, "GPIO %d off\n", abs(audio->level_gpio.gpio));
+			gpio_set(&audio->level_gpio, false);
+		}
+	}
+}
+
+/* latency histograms- eg how long the amp takes to come on after the signal does */
+void monitor_print_stats(struct audio * audio, struct monitor * m, FILE * fp){
+	char prefix[64];
+	struct hist h;
+	snprintf(prefix, sizeof(prefix), "(%s) ", audio->name);
+	fprintf(fp, "%sevents dropped %u\n", prefix, atomic_load(&audio->events->dropped));
+	hist_print(fp, prefix, "event to main loop", &m->lat_wake);
+	if(audio->level_sec){
+		if(audio->level_gpio.gpio)
+			hist_print(fp, prefix, "onset to level_gpio", &m->lat_gpio);
+		if(audio->level_cmd){
+			action_get_lat(&m->level_act, &h);
+			hist_print(fp, prefix, "onset to level_cmd start", &h);
+		}
+		if(audio->_level_sink_ports && !audio->level_gate)
+			hist_print(fp, prefix, "onset to level_sinks connected", &m->lat_connect);
+	}
+	if(audio->clip_gpio.gpio)
+		hist_print(fp, prefix, "clip to clip_gpio", &m->lat_clip_gpio);
+	if(audio->clip_cmd){
+		action_get_lat(&m->clip_act, &h);
+		hist_print(fp, prefix, "clip to clip_cmd start", &h);
+	}
+	if(audio->lat_ports.n)
+		hist_print(fp, prefix, "source port registered to connected", &audio->lat_ports);
+	if(audio->loud)
+		loudness_print(audio->loud, prefix, fp);
+	if(audio->spectrum)
+		bands_print(audio->spectrum, prefix, fp);
+	if(audio->worker)
+		offload_print(audio->worker, prefix, fp);
+	if(audio->pool)
+		fanout_print(audio->pool, prefix, fp);
+}
@@ -0,0 +1,40 @@
+/*
+ * monitor.h
+ *
+ *  Created on: 16 Oct 2026
+ */
+
+#ifndef MONITOR_H_
+#define MONITOR_H_
+
+#include "audio.h"
+#include "action.h"
+
+/* main loop state- acts on channel snapshots: VU output, clip and level trigger actions */
+struct monitor {
+	int threshold_set; /* -1 starting, 0 off, 1 triggered */
+	int clip_set;
+	bool vu_printing;
+	uint64_t _clip_hold; /* sample clock timers */
+	uint64_t _level_hold; /* timer to hold after level trigger */
+	struct action clip_act; /* clip_cmd */
+	struct action level_act; /* level_cmd */
+	/* sample clock of the event the next action is timed from, 0 for none */
+	uint64_t _onset; /* first level onset since the trigger was off */
+	uint64_t _clip_at; /* first clip */
+	uint64_t _release; /* the last channel on released- hold runs from here */
+	unsigned _levels; /* channels with the level detector on */
+	unsigned _dropped; /* events dropped so far */
+	unsigned _ports_changed; /* audio->ports_changed as of the last resync */
+	/* latency from the event to... */
+	struct hist lat_wake; /* the main loop seeing it */
+	struct hist lat_connect; /* level_sinks connected */
+	struct hist lat_gpio; /* level_gpio set */
+	struct hist lat_clip_gpio; /* clip_gpio set */
+};
+
+void monitor_init(struct audio * audio, struct monitor * m);
+void monitor_run(struct audio * audio, struct monitor * m, uint64_t now);
+void monitor_print_stats(struct audio * audio, struct monitor * m, FILE * fp);
+
+#endif /* MONITOR_H_ */
@@ -0,0 +1,63 @@
+/*
+ * offload.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Worker side of the analysis offload ring. See offload.h
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "offload.h"
+
+/* queue up to max_frames of cycles */
+struct offload * offload_init(uint64_t max_frames){
+	struct offload * o = aligned_calloc(1, sizeof(struct offload));
+	if(!o)
+		return NULL;
+	if(!((o->ring = aligned_calloc(OFFLOAD_RING, sizeof(float)))) || sem_init(&o->wake, 0, 0)){ /* calloc touches every page */
+		perror("offload");
+		free(o->ring);
+		free(o);
+		return NULL;
+	}
+	o->max_frames = max_frames;
+	return o;
+}
+
+void offload_free(struct offload * o){
+	if(!o)
+		return;
+	sem_destroy(&o->wake);
+	free(o->ring);
+	free(o);
+}
+
+/* worker- run fn on each cycle queued since last time, with its channels in place in the ring.
+ * return the number of cycles run */
+unsigned offload_run(struct offload * o, offload_fn fn, void * arg){
+	unsigned tail = atomic_load_explicit(&o->tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(&o->head, memory_order_acquire), run = 0;
+	if(head - tail > o->max_queued)
+		o->max_queued = head - tail;
+	for(; tail != head; tail++){
+		struct offload_block k = o->block[tail % OFFLOAD_BLOCKS];
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		hist_add(&o->lat, timespec_ns(&ts) - k.t);
+		fn(arg, k.bank, k.frame, o->ring + k.pos % OFFLOAD_RING, k.n);
+		atomic_store_explicit(&o->bank, k.bank, memory_order_release); /* done with the one before */
+		o->cycles++;
+		run++;
+		atomic_store_explicit(&o->pos_tail, k.pos + k.channels * k.n, memory_order_release);
+		atomic_store_explicit(&o->tail, tail + 1, memory_order_release);
+	}
+	return run;
+}
+
+void offload_print(struct offload * o, const char * prefix, FILE * fp){
+	fprintf(fp, "%soffload: %llu cycles, %u dropped, most queued %u\n", prefix,
+			(unsigned long long)o->cycles, atomic_load_explicit(&o->dropped, memory_order_relaxed), o->max_queued);
+	hist_print(fp, prefix, "offload queued to run", &o->lat);
+}
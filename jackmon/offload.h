@@ -0,0 +1,93 @@
+/*
+ * offload.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Analysis offload, offload = 1 in the config. The process callback only copies its port buffers into a ring here
+ * and posts a semaphore. A worker thread, at a realtime priority under jack's own and optionally pinned to CPUs,
+ * runs the meters on them. Cycles are dropped and counted rather than queued past offload_ms, so the meters are never
+ * more than that behind. Channels of a cycle are contiguous in the ring, so the meters read them in place.
+ */
+
+#ifndef OFFLOAD_H_
+#define OFFLOAD_H_
+
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+
+#define OFFLOAD_RING (1 << 20) /* samples- 170ms of 128 channels at 48k */
+#define OFFLOAD_BLOCKS 256 /* cycles in the ring */
+
+struct audio_bank;
+
+/* one cycle- channels of n samples one after the other from pos */
+struct offload_block {
+	struct audio_bank * bank; /* the bank the realtime thread ran the cycle with */
+	uint64_t frame; /* sample clock */
+	uint64_t t; /* monotonic ns it was queued */
+	uint32_t pos;
+	uint16_t channels;
+	uint32_t n;
+};
+
+struct offload {
+	/* single producer (realtime thread), single consumer (worker) ring of cycles */
+	_Alignas(CACHELINE) atomic_uint head; /* blocks */
+	uint32_t _pos; /* realtime thread- next sample */
+	atomic_uint dropped; /* cycles that didn't fit, or would have been later than max_frames */
+	_Alignas(CACHELINE) atomic_uint tail; /* blocks */
+	atomic_uint pos_tail; /* samples the worker is done with */
+	struct offload_block block[OFFLOAD_BLOCKS];
+	float * ring;
+	uint64_t max_frames; /* most queued- offload_ms */
+	sem_t wake; /* realtime thread posts each cycle */
+
+	/* worker */
+	_Alignas(CACHELINE) struct audio_bank * _Atomic bank; /* the bank the worker last finished a cycle with */
+	atomic_bool stop;
+	unsigned max_queued; /* most cycles waiting at once */
+	uint64_t cycles; /* run so far */
+	struct hist lat; /* queued to run */
+};
+
+/* run one cycle- its channels of n samples one after the other from x */
+typedef void (*offload_fn)(void * arg, struct audio_bank * bank, uint64_t frame, const float * x, unsigned n);
+
+/* realtime thread- queue a cycle of n samples per channel and wake the worker. Full drops it */
+static inline void offload_put(struct offload * o, struct audio_bank * bank, uint64_t frame,
+		const float * const * bufs, unsigned channels, unsigned n){
+	unsigned head = atomic_load_explicit(&o->head, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(&o->tail, memory_order_acquire);
+	uint32_t need = channels * n, pos = o->_pos;
+	if(need > OFFLOAD_RING - pos % OFFLOAD_RING) /* keep the cycle in one piece- start again at the beginning */
+		pos += OFFLOAD_RING - pos % OFFLOAD_RING;
+	/* only this thread writes the blocks, so the tails is safe to read even if the worker just took it */
+	if(head - tail >= OFFLOAD_BLOCKS || pos - atomic_load_explicit(&o->pos_tail, memory_order_acquire) + need > OFFLOAD_RING ||
+			(head != tail && frame + n - o->block[tail % OFFLOAD_BLOCKS].frame > o->max_frames)){
+		atomic_fetch_add_explicit(&o->dropped, 1, memory_order_relaxed);
+		return;
+	}
+	for(unsigned c = 0; c < channels; c++)
+		memcpy(o->ring + pos % OFFLOAD_RING + c * n, bufs[c], n * sizeof(float));
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	o->block[head % OFFLOAD_BLOCKS] = (struct offload_block){ .bank = bank, .frame = frame, .t = timespec_ns(&ts),
+		.pos = pos, .channels = channels, .n = n };
+	o->_pos = pos + need;
+	atomic_store_explicit(&o->head, head + 1, memory_order_release);
+	sem_post(&o->wake);
+}
+
+struct offload * offload_init(uint64_t max_frames);
+void offload_free(struct offload * o);
+unsigned offload_run(struct offload * o, offload_fn fn, void * arg);
+void offload_print(struct offload * o, const char * prefix, FILE * fp);
+
+#endif /* OFFLOAD_H_ */
@@ -0,0 +1,113 @@
+/*
+ * prof.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Main loop side of the process callback profiler- see prof.h
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+
+#include "prof.h"
+
+static uint64_t mono_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return timespec_ns(&ts);
+}
+
+struct prof * prof_init(unsigned interval, double samplerate){
+	struct prof * p = aligned_calloc(1, sizeof(struct prof));
+	if(!p)
+		return NULL;
+	p->interval = interval;
+	p->samplerate = samplerate;
+	p->_t0_ticks = prof_ticks();
+	p->_t0_ns = mono_ns();
+	if(interval)
+		set_timer(&p->_report, interval * 1000);
+	return p;
+}
+
+/* ns per tick. The TSC rate is measured against the clock since init, so its better the longer we run */
+static double prof_tick_ns(struct prof * p){
+#if defined(__x86_64__) || defined(__i386__)
+	uint64_t ticks = prof_ticks() - p->_t0_ticks, ns = mono_ns() - p->_t0_ns;
+	return ticks ? (double)ns / ticks : 0.0;
+#elif defined(__aarch64__)
+	uint64_t f;
+	__asm__ volatile("mrs %0, cntfrq_el0" : "=r"(f));
+	return 1e9 / f;
+#else
+	return 1.0;
+#endif
+}
+
+/* jack notification thread */
+void prof_xrun(struct prof * p){
+	atomic_fetch_add_explicit(&p->xruns, 1, memory_order_relaxed);
+}
+
+/* take the cycles since last time into the histogram, and report if its time */
+void prof_poll(struct prof * p, float cpu_load){
+	double tick_ns = prof_tick_ns(p);
+	unsigned head = atomic_load_explicit(&p->head, memory_order_acquire);
+	if(head - p->tail > PROF_CYCLES){
+		p->missed += head - p->tail - PROF_CYCLES;
+		p->tail = head - PROF_CYCLES;
+	}
+	for(; p->tail != head; p->tail++){
+		struct prof_cycle c = p->cycle[p->tail % PROF_CYCLES];
+		if(atomic_load_explicit(&p->head, memory_order_acquire) - p->tail > PROF_CYCLES){
+			p->missed++; /* overwritten while we read it */
+			continue;
+		}
+		if(!c.nframes)
+			continue;
+		double period_ns = c.nframes * 1e9 / p->samplerate;
+		double load = c.ticks * tick_ns / period_ns;
+		unsigned bin = load * PROF_BINS;
+		p->bins[bin < PROF_BINS ? bin : PROF_BINS - 1]++;
+		p->cycles++;
+		if(load > p->max_load){
+			p->max_load = load;
+			p->max_us = c.ticks * tick_ns / 1000.0;
+			p->max_period_us = period_ns / 1000.0;
+		}
+	}
+
+	if(p->interval && !timer_poll(&p->_report)){
+		prof_print(p, cpu_load, stderr);
+		set_timer(&p->_report, p->interval * 1000);
+	}
+}
+
+/* dsp load is the fraction of the period spent in our process callback */
+static double prof_percentile(const struct prof * p, double pc){
+	unsigned long want = p->cycles * pc / 100.0, n = 0;
+	for(unsigned i = 0; i < PROF_BINS; i++)
+		if((n += p->bins[i]) > want)
+			return (i + 1) * 100.0 / PROF_BINS;
+	return 100.0;
+}
+
+/* one line covering the cycles since the last report, then start again */
+void prof_print(struct prof * p, float cpu_load, FILE * fp){
+	unsigned xruns = atomic_load_explicit(&p->xruns, memory_order_relaxed);
+	fprintf(fp, "profile: %lu cycles", p->cycles);
+	if(p->cycles)
+		fprintf(fp, ", dsp load p50 <%0.1f%% p99 <%0.1f%% p99.9 <%0.1f%% max %0.1f%% (%0.0fus of %0.0fus)",
+				prof_percentile(p, 50), prof_percentile(p, 99), prof_percentile(p, 99.9),
+				p->max_load * 100, p->max_us, p->max_period_us);
+	fprintf(fp, ", xruns %u (%u total), jack cpu load %0.1f%%", xruns - p->_xruns, xruns, cpu_load);
+	if(p->missed)
+		fprintf(fp, ", %lu cycles missed", p->missed);
+	fprintf(fp, "\n");
+
+	p->_xruns = xruns;
+	p->cycles = p->missed = 0;
+	p->max_load = p->max_us = p->max_period_us = 0;
+	memset(p->bins, 0, sizeof(p->bins));
+}
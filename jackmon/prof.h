@@ -0,0 +1,81 @@
+/*
+ * prof.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Process callback profiler- profile = seconds in the config. The realtime thread stamps each cycle
+ * with a cheap counter into a ring, the main loop turns them into DSP load percentiles against the period.
+ */
+
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <stdatomic.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "utils.h"
+
+#define PROF_CYCLES 2048 /* ring- over 10s of 256 frame cycles at 48k, so the main loop never misses any */
+#define PROF_BINS 200 /* dsp load histogram in 0.5% steps, the last is 99.5% and over */
+
+struct prof_cycle {
+	uint32_t ticks; /* process callback duration */
+	uint32_t nframes;
+};
+
+struct prof {
+	/* realtime thread writes */
+	_Alignas(CACHELINE) atomic_uint head;
+	struct prof_cycle cycle[PROF_CYCLES];
+	/* jack notification thread */
+	_Alignas(CACHELINE) atomic_uint xruns;
+	/* main loop only */
+	_Alignas(CACHELINE) unsigned tail;
+	unsigned interval; /* seconds between reports- 0 on demand only */
+	struct timespec _report;
+	double samplerate;
+	uint64_t _t0_ticks, _t0_ns; /* calibration for ticks to ns */
+	unsigned long missed; /* cycles overwritten before the main loop read them */
+	unsigned long cycles;
+	double max_load; /* worst cycle- fraction of its period */
+	double max_us, max_period_us;
+	unsigned long bins[PROF_BINS];
+	unsigned _xruns; /* reported so far */
+};
+
+/* a cheap monotonic counter- TSC on x86, the generic timer on arm64, otherwise the vdso clock in ns */
+static inline uint64_t prof_ticks(void){
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t t;
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r"(t));
+	return t;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* realtime thread- record a cycle that started at ticks t0 */
+static inline void prof_cycle_end(struct prof * p, uint64_t t0, uint32_t nframes){
+	uint64_t d = prof_ticks() - t0;
+	unsigned head = atomic_load_explicit(&p->head, memory_order_relaxed);
+	struct prof_cycle * c = &p->cycle[head % PROF_CYCLES];
+	c->ticks = d > UINT32_MAX ? UINT32_MAX : d;
+	c->nframes = nframes;
+	atomic_store_explicit(&p->head, head + 1, memory_order_release);
+}
+
+struct prof * prof_init(unsigned interval, double samplerate);
+void prof_xrun(struct prof * p);
+void prof_poll(struct prof * p, float cpu_load);
+void prof_print(struct prof * p, float cpu_load, FILE * fp);
+
+#endif /* PROF_H_ */
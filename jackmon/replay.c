@@ -0,0 +1,243 @@
+/*
+ * replay.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Offline replay of audio files through the jackmon meters- no sound server needed.
+ * Takes the same config and options as jackmon, and writes the same VU stream.
+ * Clip and level trigger changes are printed as "@<seconds> CLIP=1" style event lines
+ * instead of running scripts, GPIOs or jack connections.
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "audio.h"
+#include "config.h"
+#include "monitor.h"
+#include "utils.h"
+
+enum sample_fmt {
+	FMT_F32,
+	FMT_S16,
+	FMT_S24,
+	FMT_S32,
+};
+
+struct input {
+	FILE * fp;
+	unsigned channels;
+	unsigned samplerate;
+	enum sample_fmt fmt;
+	unsigned bytes; /* per sample */
+};
+
+/* raw input and block size from command line */
+static unsigned replay_samplerate = 48000;
+static unsigned replay_channels;
+static unsigned replay_frames = 256;
+
+static int replay_opt(int o, char * arg){
+	switch(o){
+	case 'r':
+		replay_samplerate = strtoul(arg, NULL, 0);
+		return 0;
+	case 'k':
+		replay_channels = strtoul(arg, NULL, 0);
+		return 0;
+	case 'b':
+		replay_frames = strtoul(arg, NULL, 0);
+		return 0;
+	}
+	return 1;
+}
+
+static const struct config_ext replay_ext = {
+	.opts = "r:k:b:",
+	.help = "Replay: jackmon-replay [options] file\n"
+		"\tfile\tWAV (16/24/32 bit PCM or 32 bit float) or raw interleaved 32 bit float. Use - for stdin\n"
+		"\t-r\tsample rate of raw input, default 48000\n"
+		"\t-k\tnumber of channels of raw input\n"
+		"\t-b\tframes per block, like the jack period. Default 256\n",
+	.opt = replay_opt,
+};
+
+static uint32_t le32(const uint8_t * p){
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t le16(const uint8_t * p){
+	return p[0] | p[1] << 8;
+}
+
+/* parse RIFF header up to the data chunk. return 0 if its a WAV we can read, 1 if not a WAV, -1 on error */
+static int wav_open(struct input * in){
+	uint8_t h[12];
+	if(fread(h, 1, sizeof(h), in->fp) != sizeof(h) || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4))
+		return 1;
+
+	bool fmt = false;
+	while(true){
+		uint8_t c[8];
+		if(fread(c, 1, sizeof(c), in->fp) != sizeof(c))
+			return -1;
+		uint32_t len = le32(c + 4);
+		if(!memcmp(c, "data", 4))
+			return fmt ? 0 : -1;
+		if(memcmp(c, "fmt ", 4) || len < 16){ /* skip other chunks- padded to even length */
+			for(uint32_t i = 0; i < len + (len & 1); i++)
+				if(fgetc(in->fp) == EOF)
+					return -1;
+			continue;
+		}
+
+		uint8_t f[40] = {0};
+		if(len > sizeof(f) || fread(f, 1, len + (len & 1), in->fp) != len + (len & 1))
+			return -1;
+		unsigned tag = le16(f);
+		if(tag == 0xfffe && len >= 40) /* WAVE_FORMAT_EXTENSIBLE- format from sub format GUID */
+			tag = le16(f + 24);
+		in->channels = le16(f + 2);
+		in->samplerate = le32(f + 4);
+		unsigned bits = le16(f + 14);
+		in->bytes = bits / 8;
+		if(tag == 3 && bits == 32)
+			in->fmt = FMT_F32;
+		else if(tag == 1 && bits == 16)
+			in->fmt = FMT_S16;
+		else if(tag == 1 && bits == 24)
+			in->fmt = FMT_S24;
+		else if(tag == 1 && bits == 32)
+			in->fmt = FMT_S32;
+		else {
+			fprintf(stderr, "Unsupported WAV format %u, %u bits\n", tag, bits);
+			return -1;
+		}
+		fmt = true;
+	}
+}
+
+/* read up to frames interleaved samples as float. return frames read */
+static size_t input_read(struct input * in, float * buf, uint8_t * raw, size_t frames){
+	size_t n = fread(raw, in->bytes * in->channels, frames, in->fp);
+	size_t samples = n * in->channels;
+	for(size_t i = 0; i < samples; i++){
+		const uint8_t * p = raw + i * in->bytes;
+		switch(in->fmt){
+		case FMT_F32:
+			memcpy(&buf[i], p, sizeof(float));
+			break;
+		case FMT_S16:
+			buf[i] = (int16_t)le16(p) / 32768.0f;
+			break;
+		case FMT_S24:
+			buf[i] = (int32_t)(le32((uint8_t[]){0, p[0], p[1], p[2]})) / 2147483648.0f;
+			break;
+		case FMT_S32:
+			buf[i] = (int32_t)le32(p) / 2147483648.0f;
+			break;
+		}
+	}
+	return n;
+}
+
+int main(int argc, char *argv[]){
+	struct audio audio = {0};
+	config_parse(&audio, argc, argv, &replay_ext);
+
+	int err;
+	if((err = config_defaults(&audio)))
+		return err;
+
+	if(optind >= argc){
+		fprintf(stderr, "No input file\n");
+		return 2;
+	}
+
+	struct input in = { .fmt = FMT_F32, .bytes = sizeof(float) };
+	const char * path = argv[optind];
+	if(!strcmp(path, "-"))
+		in.fp = stdin;
+	else if(!((in.fp = fopen(path, "rb")))){
+		fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+		return 2;
+	}
+
+	if(in.fp == stdin || ((err = wav_open(&in))) > 0){ /* raw float */
+		if(in.fp != stdin)
+			rewind(in.fp);
+		in.channels = replay_channels;
+		in.samplerate = replay_samplerate;
+		in.fmt = FMT_F32;
+		in.bytes = sizeof(float);
+	} else if(err < 0){
+		fprintf(stderr, "Can't read WAV header from %s\n", path);
+		return 2;
+	}
+	if(!in.channels || !in.samplerate || !replay_frames){
+		fprintf(stderr, "Need channels (-k), sample rate (-r) and block size (-b) for raw input\n");
+		return 2;
+	}
+	debug(&audio, "Replaying %s: %u channels at %uHz, %u frame blocks\n", path, in.channels, in.samplerate, replay_frames);
+
+	if(audio_init_offline(&audio, in.samplerate, in.channels)){
+		fprintf(stderr, "Audio init failed\n");
+		return 1;
+	}
+
+	float * inter = malloc(sizeof(float) * replay_frames * in.channels);
+	float * chans = malloc(sizeof(float) * replay_frames * in.channels);
+	const float ** bufs = malloc(sizeof(float *) * in.channels);
+	uint8_t * raw = malloc(in.bytes * replay_frames * in.channels);
+	if(!inter || !chans || !bufs || !raw)
+		return 1;
+	for(unsigned c = 0; c < in.channels; c++)
+		bufs[c] = chans + c * replay_frames;
+
+	/* main loop would poll at this rate, or on the next wake up */
+	uint64_t period = (uint64_t)in.samplerate * (audio.vu_ms ?: 1457) / 1000;
+	uint64_t pos = 0, polled = 0;
+	struct monitor mon;
+	monitor_init(&audio, &mon);
+
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	size_t n;
+	while((n = input_read(&in, inter, raw, replay_frames))){
+		for(unsigned c = 0; c < in.channels; c++)
+			for(size_t i = 0; i < n; i++)
+				chans[c * replay_frames + i] = inter[i * in.channels + c];
+
+		if(audio_process(&audio, pos, bufs, n))
+			audio_wake(&audio);
+		if(audio.spectrum)
+			bands_run(audio.spectrum); /* no worker thread- analyse each block as it goes */
+		pos += n;
+
+		if(atomic_load(&audio.wake_pending) || pos - polled >= period){
+			audio_poll(&audio);
+			polled = pos;
+			monitor_run(&audio, &mon, audio_now(&audio));
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	fflush(stdout);
+	if(audio.loud){
+		loudness_poll(audio.loud);
+		loudness_print(audio.loud, "", stderr);
+	}
+
+	double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+	double audio_secs = (double)pos / in.samplerate;
+	fprintf(stderr, "Replayed %0.1fs of audio, %u channels in %0.3fs: %0.0f samples/sec/channel, %0.1fx realtime\n",
+			audio_secs, in.channels, secs, secs > 0 ? pos / secs : 0.0, secs > 0 ? audio_secs / secs : 0.0);
+
+	fifo_close(audio.h_vu_pipe);
+	vushm_close(&audio);
+	return 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * test.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Checks for the make check tests. Each case prints its line with ok or FAIL after it, and the test exits non zero
+ * if any failed.
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+static unsigned test_failed;
+
+/* print a case and whether it passed. return ok */
+static inline bool check(bool ok, const char * fmt, ...){
+	va_list args;
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+	printf(" %s\n", ok ? "ok" : "FAIL");
+	test_failed += !ok;
+	return ok;
+}
+
+/* exit status for main */
+static inline int test_done(void){
+	printf("# %u failed\n", test_failed);
+	return test_failed ? 1 : 0;
+}
+
+#endif /* TEST_H_ */
@@ -0,0 +1,65 @@
+/*
+ * test_action.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Action executor tests- one shot and deduped actions, ${VAR} substitution and a command that can't be run.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+
+#include "action.h"
+#include "utils.h"
+#include "test.h"
+
+/* wait up to 2s for the executor to have taken n requests off the queue, and reaped the ones it ran */
+static void action_wait(unsigned long n, unsigned long reaped, struct action_stats * st){
+	for(unsigned i = 0; i < 200; i++){
+		action_get_stats(st);
+		if(st->run + st->dropped >= n && st->reaped >= reaped && !st->depth)
+			return;
+		millisleep(10);
+	}
+}
+
+static bool stats_are(const struct action_stats * st, unsigned long run, unsigned long dropped, unsigned long failed){
+	return st->run == run && st->dropped == dropped && st->failed == failed;
+}
+
+int main(void){
+	struct action once, both, bad;
+	struct action_stats st;
+	/* the command fails unless ${CLIP} was substituted */
+	action_init(&once, "test '${CLIP}' = 1", "CLIP", 1000);
+	action_init(&both, "test '${CLIP}' = 1", "CLIP", 1000);
+	action_init(&bad, "/nonexistent/jackmon-test ${CLIP}", "CLIP", 1000);
+	both.dedupe = bad.dedupe = true;
+	if(action_start())
+		return 1;
+
+	printf("# action executor- cumulative counts\n");
+	printf("%-10s %4s %7s %7s %7s\n", "action", "runs", "dropped", "failed", "expect");
+
+	/* one shot clip_cmd (clip_ms = 0) posts CLIP=1 for each clip after the hold, and never 0- each has to run */
+	action_post(&once, 1);
+	action_wait(1, 1, &st);
+	action_post(&once, 1);
+	action_wait(2, 2, &st);
+	check(stats_are(&st, 2, 0, 0), "%-10s %4lu %7lu %7lu %7s", "one shot", st.run, st.dropped, st.failed, "2 0 0");
+
+	/* with dedupe, as for level_cmd and clip_cmd with clip_ms, a repeat of the last state is dropped */
+	action_post(&both, 1);
+	action_wait(3, 3, &st);
+	action_post(&both, 1);
+	action_wait(4, 3, &st);
+	check(stats_are(&st, 3, 1, 0), "%-10s %4lu %7lu %7lu %7s", "dedupe", st.run, st.dropped, st.failed, "3 1 0");
+
+	/* a command that never started didn't set the state- the repeat tries again */
+	action_post(&bad, 1);
+	action_wait(5, 3, &st);
+	action_post(&bad, 1);
+	action_wait(6, 3, &st);
+	check(stats_are(&st, 5, 1, 2), "%-10s %4lu %7lu %7lu %7s", "no spawn", st.run, st.dropped, st.failed, "5 1 2");
+	return test_done();
+}
@@ -0,0 +1,71 @@
+/*
+ * test_bands.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Band analyser tests- a -20dBFS sine at each octave and third octave centre through bands_put() and bands_run(), at
+ * 44.1k to 192k. The band it's in reads its level, and the bands either side are well under it. Built as
+ * test_bands-float and test_bands-double.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "utils.h"
+#include "dsp.h"
+#include "bands.h"
+#include "test.h"
+
+/* bounds, after 0.5s to settle */
+#define BAND_DB 0.5 /* the band the sine is in */
+#define BAND_NEXT_DB -6.0 /* the bands either side, at most */
+
+int main(void){
+	static const double rates[] = { 44100.0, 48000.0, 96000.0, 192000.0 };
+	float x[256], level[BANDS_MAX_CHANNELS * BANDS_MAX];
+	const float * in[1] = { x };
+	printf("# band analyser, ftype %s- a -20dBFS sine at each centre, worst error in its band and loudest band next to it\n",
+			FTYPE_NAME);
+	printf("# bounds: %0.1fdB, %0.1fdB. Bands too near Nyquist are skipped\n", BAND_DB, BAND_NEXT_DB);
+	printf("%-6s %7s %6s %9s %9s %9s\n", "bands", "rate", "stages", "centre", "next", "skipped");
+	for(unsigned r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+		for(unsigned nb = 10; nb <= BANDS_MAX; nb += BANDS_MAX - 10){
+			double rate = rates[r], err = 0.0, next = -INFINITY;
+			unsigned skipped = 0, stages = 0;
+			bool ok = true;
+			for(unsigned j = 0; j < nb && ok; j++){
+				struct bands * b = bands_init(nb, rate, rate / 4);
+				if(!b){
+					ok = false;
+					break;
+				}
+				stages = b->stages;
+				if(b->band[j].stage >= BANDS_STAGES){
+					skipped++;
+					bands_free(b);
+					continue;
+				}
+				uint64_t periods = 0;
+				for(uint64_t f = 0; f < rate; f += 256){
+					for(unsigned i = 0; i < 256; i++)
+						x[i] = 0.1 * sin(2.0 * M_PI * b->band[j].fc * (f + i) / rate);
+					bands_put(b, in, 1, 256);
+					bands_run(b);
+				}
+				bands_get(b, level, &periods); /* the last 0.25s, lowest band first */
+				float * l = level + nb - 1; /* l[-k] is band[k] */
+				double e = 20.0 * log10(l[-(int)j] / (0.1 * M_SQRT1_2));
+				if(fabs(e) > fabs(err))
+					err = e;
+				for(int k = (int)j - 1; k <= (int)j + 1; k += 2)
+					if(k >= 0 && k < (int)nb && b->band[k].stage < BANDS_STAGES && 20.0 * log10(l[-k] / l[-(int)j]) > next)
+						next = 20.0 * log10(l[-k] / l[-(int)j]);
+				bands_free(b);
+			}
+			check(ok && fabs(err) <= BAND_DB && next <= BAND_NEXT_DB, "%-6u %7.0f %6u %+9.3f %+9.2f %9u", nb, rate,
+					stages, err, next, skipped);
+		}
+	return test_done();
+}
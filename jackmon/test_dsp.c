@@ -0,0 +1,134 @@
+/*
+ * test_dsp.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Meter accuracy tests- rms, held peak and level onset and release through dsp_run(), against a full rate double
+ * reference on test signals at 44.1k to 192k in jack sized blocks. Built as test_dsp-float and test_dsp-double.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "utils.h"
+#include "dsp.h"
+#include "test.h"
+
+/* test signals- -20dBFS unless noted */
+static const char * acc_names[] = { "sine 1k", "sine 40", "sine 15k", "burst 1k", "noise", "sine -60" };
+#define ACC_SIGNALS (sizeof(acc_names) / sizeof(acc_names[0]))
+
+static double acc_amp(unsigned sig){
+	return sig == 5 ? 0.001 : 0.1;
+}
+
+static float acc_sample(unsigned sig, uint64_t i, double rate, uint32_t * rnd){
+	double t = i / rate, a = acc_amp(sig);
+	switch(sig){
+	case 0:
+	case 5:
+		return a * sin(2.0 * M_PI * 1000.0 * t);
+	case 1:
+		return a * sin(2.0 * M_PI * 40.0 * t);
+	case 2:
+		return a * sin(2.0 * M_PI * 15000.0 * t);
+	case 3: /* 1s on after 0.5s of silence */
+		return t >= 0.5 && t < 1.5 ? a * sin(2.0 * M_PI * 1000.0 * t) : 0.0;
+	default: /* uniform white noise, rms a */
+		*rnd = *rnd * 1664525u + 1013904223u;
+		return a * sqrt(3.0) * ((int32_t)*rnd / 2147483648.0);
+	}
+}
+
+/* reference rms detector- the same 6Hz low pass as a plain biquad at the full rate, in double whatever ftype is */
+struct acc_ref {
+	double b0, b1, a1, a2;
+	double z1, z2, y;
+};
+
+static void acc_ref_init(struct acc_ref * f, double rate){
+	double omega = 2.0 * M_PI * 6.0 / rate, alpha = sin(omega) / (2.0 * M_SQRT1_2), s = 1.0 / (1.0 + alpha);
+	f->b1 = s * (1.0 - cos(omega));
+	f->b0 = f->b1 * 0.5;
+	f->a1 = s * -2.0 * cos(omega);
+	f->a2 = s * (1.0 - alpha);
+	f->z1 = f->z2 = f->y = 0.0;
+}
+
+static void acc_ref_run(struct acc_ref * f, double x){
+	f->y = f->b0 * x + f->z1;
+	f->z1 = f->b1 * x - f->a1 * f->y + f->z2;
+	f->z2 = f->b0 * x - f->a2 * f->y;
+}
+
+/* bounds on the meters against the reference */
+#define ACC_RMS_DB 0.05 /* mean rms error over 1.0-1.5s, once settled */
+#define ACC_PEAK_DB 0.001 /* held peak against the largest sample */
+#define ACC_EDGE_MS 2.0 /* level onset and release, threshold 10dB under the signal */
+
+/* an edge time in ms, or - if there wasn't one */
+static const char * edge_ms(char * buf, size_t len, int64_t at, double ms){
+	if(at >= 0)
+		snprintf(buf, len, "%+9.2f", ms);
+	else
+		snprintf(buf, len, "%9s", "-");
+	return buf;
+}
+
+int main(void){
+	static const double rates[] = { 44100.0, 48000.0, 96000.0, 192000.0 };
+	dsp_init();
+	printf("# accuracy, ftype %s- 2s of each signal in 256 frame blocks, level threshold 10dB under it\n", FTYPE_NAME);
+	printf("# bounds: rms %0.2fdB, peak %0.3fdB, onset and release %0.1fms\n", ACC_RMS_DB, ACC_PEAK_DB, ACC_EDGE_MS);
+	printf("%-10s %7s %4s %9s %9s %9s %9s %9s\n", "signal", "rate", "dec", "ref dB", "rms err", "peak err", "onset ms", "rel ms");
+	for(unsigned r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+		for(unsigned sig = 0; sig < ACC_SIGNALS; sig++){
+			double rate = rates[r], thres = acc_amp(sig) * acc_amp(sig) / 20.0; /* sine mean square -10dB */
+			struct meter m = { 0 };
+			struct meter_state s = { 0 };
+			struct acc_ref ref;
+			rms_init(&m.rms, rate, 0);
+			m.rms.thres_sq = m.rms.rel_sq = thres;
+			peak_init(&m.peak, 0.001, rate, 4 * rate); /* holds the whole run */
+			acc_ref_init(&ref, rate);
+			float x[256], max = 0.0f;
+			uint32_t rnd = 1;
+			double err = 0.0;
+			unsigned n = 0;
+			int64_t on = -1, rel = -1, ref_on = -1, ref_rel = -1;
+			for(uint64_t f = 0; f < 2 * rate; f += 256){
+				for(unsigned i = 0; i < 256; i++){
+					x[i] = acc_sample(sig, f + i, rate, &rnd);
+					if(fabsf(x[i]) > max)
+						max = fabsf(x[i]);
+					acc_ref_run(&ref, (double)x[i] * x[i]);
+					if(ref_on < 0 && ref.y >= thres)
+						ref_on = f + i;
+					else if(ref_on >= 0 && ref_rel < 0 && ref.y < thres)
+						ref_rel = f + i;
+				}
+				dsp_run(&m, &s, x, 256, f);
+				if(on < 0 && s.level_at >= 0)
+					on = f + s.level_at;
+				if(on >= 0 && rel < 0 && s.release_at >= 0)
+					rel = f + s.release_at;
+				double t = (f + 256) / rate;
+				if(t >= 1.0 && t < 1.5){
+					err += 20.0 * log10(rms_get(&s.rms) / sqrt(ref.y));
+					n++;
+				}
+			}
+			err /= n;
+			double peak_err = 20.0 * log10(s.peak.peak / max);
+			double on_ms = (on - ref_on) * 1000.0 / rate, rel_ms = (rel - ref_rel) * 1000.0 / rate;
+			bool edges = (on < 0) == (ref_on < 0) && (rel < 0) == (ref_rel < 0) &&
+					(on < 0 || fabs(on_ms) <= ACC_EDGE_MS) && (rel < 0 || fabs(rel_ms) <= ACC_EDGE_MS);
+			char on_s[16], rel_s[16];
+			check(fabs(err) <= ACC_RMS_DB && fabs(peak_err) <= ACC_PEAK_DB && edges, "%-10s %7.0f %4u %9.3f %+9.4f %+9.4f %s %s",
+					acc_names[sig], rate, m.rms.decimate, 10.0 * log10(ref.y), err, peak_err,
+					edge_ms(on_s, sizeof(on_s), on, on_ms), edge_ms(rel_s, sizeof(rel_s), rel, rel_ms));
+		}
+	return test_done();
+}
@@ -0,0 +1,97 @@
+/*
+ * test_fanout.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Fanout tests- the meters of a 48 channel bank run serially and split across 1 to 4 helper threads, over bursts,
+ * clips and silence. Every channel's state and the events each block come out the same, and under fanout_min
+ * channels it runs serially.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "utils.h"
+#include "dsp.h"
+#include "fanout.h"
+#include "test.h"
+
+#define CHANS 48
+#define FRAMES 256
+#define RATE 48000.0
+
+static struct meter meter;
+
+/* a block of the bank- x is channel after channel */
+struct block {
+	struct meter_state * state;
+	const float * x;
+	uint64_t frame;
+};
+
+static unsigned meters(void * arg, unsigned from, unsigned to){
+	const struct block * k = arg;
+	unsigned events = 0;
+	for(unsigned c = from; c < to; c++)
+		events += dsp_run(&meter, &k->state[c], k->x + c * FRAMES, FRAMES, k->frame);
+	return events;
+}
+
+/* channel c at frame- a sine at its own frequency and level, on and off, with a clip now and then */
+static float signal(unsigned c, uint64_t frame){
+	double t = frame / RATE;
+	if(((frame >> 13) + c) % 3 == 0)
+		return 0.0f;
+	if(frame % 20000 < c % 6)
+		return 1.0f;
+	return (0.01 + 0.02 * (c % 8)) * sin(2.0 * M_PI * (100.0 + 50.0 * c) * t);
+}
+
+int main(void){
+	static float x[CHANS * FRAMES];
+	struct meter_state * serial = aligned_calloc(CHANS, sizeof(struct meter_state));
+	struct meter_state * fanned = aligned_calloc(CHANS, sizeof(struct meter_state));
+	if(!serial || !fanned)
+		return 1;
+	dsp_init();
+	rms_init(&meter.rms, RATE, 0);
+	peak_init(&meter.peak, fpow(10.0, -65.0/20.0), RATE * 800 / 1000, RATE * 800 / 1000); /* jackmon defaults */
+	clip_init(&meter.clip, 4);
+	loud_init(&meter.loud, RATE);
+	win_init(&meter.win, RATE * 50 / 1000, 3, 0.001, 0.001);
+	meter.true_peak = true;
+
+	printf("# fanout, ftype %s- %u channels of %u frame blocks, 2s, against serial\n", FTYPE_NAME, CHANS, FRAMES);
+	printf("%7s %7s %9s %9s %7s\n", "threads", "min", "fanned", "serial", "events");
+	for(unsigned threads = 1; threads <= 4; threads++)
+		for(unsigned min = 0; min <= CHANS + 1; min += CHANS + 1){
+			struct fanout * f = fanout_init(threads, min, 0);
+			if(!f)
+				return 1;
+			memset(serial, 0, CHANS * sizeof(struct meter_state));
+			memset(fanned, 0, CHANS * sizeof(struct meter_state));
+			bool same = true;
+			unsigned long events = 0;
+			for(uint64_t frame = 0; frame < 2 * RATE; frame += FRAMES){
+				for(unsigned c = 0; c < CHANS; c++)
+					for(unsigned i = 0; i < FRAMES; i++)
+						x[c * FRAMES + i] = signal(c, frame + i);
+				struct block s = { serial, x, frame }, k = { fanned, x, frame };
+				unsigned n = meters(&s, 0, CHANS);
+				same &= fanout_run(f, meters, &k, CHANS) == n;
+				events += n;
+			}
+			same &= !memcmp(serial, fanned, CHANS * sizeof(struct meter_state));
+			check(same && f->threads == threads && events && (min > CHANS ? !f->cycles : !f->serial),
+					"%7u %7u %9llu %9llu %7lu", threads, min, (unsigned long long)f->cycles,
+					(unsigned long long)f->serial, events);
+			fanout_free(f);
+		}
+	free(serial);
+	free(fanned);
+	return test_done();
+}
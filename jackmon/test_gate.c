@@ -0,0 +1,86 @@
+/*
+ * test_gate.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * level_gate tests- the gain ramp through gate_run() and gate_apply(), driven by the level detector on a burst at
+ * 44.1k to 192k, in blocks that divide the signal evenly and ones that don't. Built as test_gate-float and
+ * test_gate-double.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "utils.h"
+#include "dsp.h"
+#include "test.h"
+
+/* 1k at -20dBFS, 1s on after 0.5s of silence */
+#define BURST_AMP 0.1
+
+static float burst(uint64_t i, double rate){
+	double t = i / rate;
+	return t >= 0.5 && t < 1.5 ? BURST_AMP * sin(2.0 * M_PI * 1000.0 * t) : 0.0;
+}
+
+/* a 10ms ramp and 500ms hold */
+#define GATE_RAMP_MS 10.0
+#define GATE_HOLD_MS 500.0
+
+int main(void){
+	static const double rates[] = { 44100.0, 48000.0, 96000.0, 192000.0 };
+	static const unsigned blocks[] = { 64, 256, 1000 };
+	float x[1000], ones[1000], gain[1000];
+	for(unsigned i = 0; i < 1000; i++)
+		ones[i] = 1.0f;
+	dsp_init();
+	printf("# level_gate, ftype %s- burst with the level threshold 10dB under it, %0.0fms ramp and %0.0fms hold\n",
+			FTYPE_NAME, GATE_RAMP_MS, GATE_HOLD_MS);
+	printf("# opens on the onset sample and closes on the sample the hold runs out, never stepping more than the ramp\n");
+	printf("%7s %5s %9s %9s %9s\n", "rate", "block", "open", "close", "max step");
+	for(unsigned r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+		for(unsigned k = 0; k < sizeof(blocks) / sizeof(blocks[0]); k++){
+			double rate = rates[r];
+			unsigned n = blocks[k], ramp = lrint(rate * GATE_RAMP_MS / 1000.0);
+			uint64_t hold = lrint(rate * GATE_HOLD_MS / 1000.0);
+			struct meter m = { 0 };
+			struct meter_state s = { 0 };
+			struct gate g;
+			struct gate_state gs = { 0 };
+			rms_init(&m.rms, rate, 0);
+			m.rms.thres_sq = m.rms.rel_sq = BURST_AMP * BURST_AMP / 20.0; /* sine mean square -10dB */
+			gate_init(&g, ramp, hold);
+			int64_t on = -1, rel = -1, open = -1, close = -1;
+			double last = 0.0, step = 0.0;
+			bool full = false;
+			for(uint64_t f = 0; f < 3 * rate; f += n){
+				for(unsigned i = 0; i < n; i++)
+					x[i] = burst(f + i, rate);
+				dsp_run(&m, &s, x, n, f);
+				if(on < 0 && s.level_at >= 0)
+					on = f + s.level_at;
+				if(s.release_at >= 0)
+					rel = f + s.release_at;
+				/* the gain, from gating ones */
+				gate_run(&g, &gs, dsp_level_on(&m, &s), s.level_at, s.release_at, f, n);
+				gate_apply(&g, &gs, ones, gain, n);
+				for(unsigned i = 0; i < n; i++){
+					if(fabs(gain[i] - last) > step)
+						step = fabs(gain[i] - last);
+					if(open < 0 && gain[i] > 0.0f)
+						open = f + i;
+					full |= gain[i] == 1.0f;
+					if(full && close < 0 && gain[i] < 1.0f)
+						close = f + i;
+					last = gain[i];
+				}
+			}
+			check(on >= 0 && rel >= 0 && open == on && close == rel + (int64_t)hold && last == 0.0 &&
+					step <= 1.0 / ramp + 1e-6, /* float gains are only good to 6e-8 near 1 */
+					"%7.0f %5u %+9" PRId64 " %+9" PRId64 " %9.6f", rate, n, open - on, close - rel - (int64_t)hold, step);
+		}
+	return test_done();
+}
@@ -0,0 +1,173 @@
+/*
+ * test_ports.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Channel bank tests against jackstub.c- sources coming and going while the client runs. Channels keep their port,
+ * sink and meter state by source, nothing is left connected to a port or sink that moved on, and events queued
+ * from the bank before are credited to the right channel. A new source is connected from its registration callback
+ * before the next process cycle.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "host.h"
+#include "config.h"
+#include "jackstub.h"
+#include "test.h"
+
+static struct host host;
+static struct host_ctx ctx;
+static struct host_ctx * ctxs[] = { &ctx };
+
+/* the main loop, as host_poll() does it for a context without waiting */
+static void poll_ctx(void){
+	audio_poll(&ctx.audio);
+	monitor_run(&ctx.audio, &ctx.mon, audio_now(&ctx.audio));
+	if(ctx.audio.resync || ctx.audio._sinks_changed)
+		jack_check_ports(&ctx.audio);
+}
+
+/* run n cycles, polling after each */
+static void run(unsigned n){
+	for(unsigned i = 0; i < n; i++){
+		jackstub_cycle();
+		poll_ctx();
+	}
+}
+
+/* rescan once the callbacks flagged a change, as the main loop does when woken. return true if a bank was swapped in */
+static bool swap(void){
+	unsigned changed = ctx.audio.ports_changed;
+	jack_check_ports(&ctx.audio);
+	return ctx.audio.ports_changed != changed;
+}
+
+/* channel of bank connected to source, or -1 */
+static int chan_of(const char * source){
+	const struct audio_bank * b = atomic_load(&ctx.audio.bank);
+	for(unsigned i = 0; i < b->channels; i++)
+		if(!strcmp(b->sources[i], source))
+			return i;
+	return -1;
+}
+
+/* source connected to our port num, only to it, and to the sink of the same number */
+static bool wired(const char * source, unsigned num){
+	char port[32], sink[32];
+	snprintf(port, sizeof(port), "jackmon:%u", num);
+	snprintf(sink, sizeof(sink), "amp:in_%u", num);
+	const struct audio_bank * b = atomic_load(&ctx.audio.bank);
+	int i = chan_of(source);
+	return i >= 0 && b->port[i] == num && jackstub_connected(source, port) && jackstub_connected(source, sink) &&
+			jackstub_connections(source) == 2 && jackstub_connections(port) == 1 && jackstub_connections(sink) == 1;
+}
+
+/* events queued now- return how many, and the channels they're from as bits */
+static unsigned events(unsigned * chans, bool * clip){
+	struct audio_event ev;
+	unsigned n = 0;
+	*chans = 0;
+	*clip = false;
+	while(audio_event_get(&ctx.audio, &ev)){
+		*chans |= 1u << ev.chan;
+		*clip |= ev.type == AUDIO_EVENT_CLIP;
+		n++;
+	}
+	return n;
+}
+
+int main(void){
+	struct audio * audio = &ctx.audio;
+	char name[32];
+	for(unsigned i = 1; i <= 5; i++){
+		snprintf(name, sizeof(name), "sys:capture_%u", i);
+		if(i <= 4)
+			jackstub_add(name, JackPortIsOutput);
+		jackstub_signal(name, 0.1f, 0);
+		snprintf(name, sizeof(name), "amp:in_%u", i);
+		jackstub_add(name, JackPortIsInput);
+	}
+
+	audio->name = "jackmon";
+	audio->sources = "sys:capture_.*";
+	audio->level_sinks = "amp:in_.*";
+	if(config_defaults(audio))
+		return 1;
+	audio->clip_en = true; /* events to carry over a swap */
+	audio->clip_samples = 4;
+	host.name = audio->name;
+	host.ctx = ctxs;
+	host.n = 1;
+	if(host_init(&host))
+		return 1;
+	run(20); /* over -65dB- triggered, so the sinks are connected */
+
+	printf("# channel bank, 4 sources, level_sinks connected\n");
+	check(audio->channels == 4 && wired("sys:capture_1", 1) && wired("sys:capture_2", 2) && wired("sys:capture_3", 3) &&
+			wired("sys:capture_4", 4), "%-40s", "ports 1-4, each to its source and sink");
+
+	/* a source in the middle goes- the ones after it move down the bank, and keep their port, sink and state. A
+	 * cycle runs on the old bank before the main loop gets to it */
+	int c3 = chan_of("sys:capture_3");
+	ftype rms = audio->chan[c3].rms_val;
+	jackstub_remove("sys:capture_2");
+	jackstub_signal("sys:capture_4", 0.1f, 8);
+	jackstub_cycle();
+	check(swap(), "%-40s", "capture_2 gone, swapped");
+	unsigned chans;
+	bool clip;
+	unsigned n = events(&chans, &clip);
+	check(n && clip && chans == 1u << chan_of("sys:capture_4"), "%-40s %u events, channels 0x%x", "old bank events moved", n,
+			chans);
+	run(1);
+	check(audio->channels == 3 && !jackstub_exists("jackmon:2") && !jackstub_connections("amp:in_2"), "%-40s",
+			"port 2 unregistered, sink 2 free");
+	check(wired("sys:capture_1", 1) && wired("sys:capture_3", 3) && wired("sys:capture_4", 4), "%-40s",
+			"ports 1, 3, 4 kept their sources and sinks");
+	ftype now = audio->chan[chan_of("sys:capture_3")].rms_val;
+	check(fabs(20.0 * log10(now / rms)) < 0.5, "%-40s %+0.2fdB", "capture_3 meter carried over", 20.0 * log10(now / rms));
+
+	/* one goes and one comes- the new one gets the lowest port free. Events from the one that went are dropped */
+	jackstub_signal("sys:capture_1", 0.1f, 8);
+	jackstub_cycle();
+	jackstub_remove("sys:capture_1");
+	jackstub_add("sys:capture_5", JackPortIsOutput);
+	jackstub_signal("sys:capture_5", 0.1f, 0);
+	check(swap(), "%-40s", "capture_1 gone, capture_5 new, swapped");
+	n = events(&chans, &clip);
+	check(!clip, "%-40s %u events, channels 0x%x", "old bank events from capture_1 dropped", n, chans);
+	run(2);
+	check(audio->channels == 3 && !jackstub_exists("jackmon:1") && !jackstub_connections("amp:in_1"), "%-40s",
+			"port 1 unregistered, sink 1 free");
+	check(wired("sys:capture_3", 3) && wired("sys:capture_4", 4) && wired("sys:capture_5", 2), "%-40s",
+			"capture_5 on port 2 and its sink");
+
+	/* registration to connected- the callback wakes the main loop, which connects it before the next cycle. It
+	 * meters from that cycle on */
+	printf("# hot add, registration to connected\n");
+	unsigned long reg = jackstub_cycles(), connected = ~0ul, metered = ~0ul;
+	unsigned long lat = audio->lat_ports.n;
+	jackstub_add("sys:capture_6", JackPortIsOutput);
+	jackstub_signal("sys:capture_6", 0.1f, 0);
+	for(unsigned i = 0; i < 8 && metered == ~0ul; i++){
+		poll_ctx();
+		int c6 = chan_of("sys:capture_6");
+		if(connected == ~0ul && c6 >= 0 && jackstub_connected("sys:capture_6", "jackmon:1"))
+			connected = jackstub_cycles() - reg;
+		if(c6 >= 0 && audio->chan[c6].rms_val > 0.0)
+			metered = jackstub_cycles() - reg;
+		jackstub_cycle();
+	}
+	check(connected == 0, "%-40s %lu cycles", "capture_6 connected to port 1", connected);
+	check(metered <= 1, "%-40s %lu cycles", "capture_6 metered", metered);
+	check(audio->lat_ports.n == lat + 1, "%-40s %0.1fus", "lat_ports has it",
+			audio->lat_ports.n ? audio->lat_ports.max_ns / 1000.0 : 0.0);
+	run(2);
+	check(audio->channels == 4 && wired("sys:capture_6", 1), "%-40s", "capture_6 on port 1 and its sink");
+	host_close(&host);
+	return test_done();
+}
@@ -10,11 +10,20 @@
 
 #define _GNU_SOURCE
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <time.h>
 #include <math.h>
+#include <stdatomic.h>
 
-#if !defined(__arm__) && !defined(__aarch64__)
+/* float on every architecture- the rms filter is compensated for it. -DFTYPE_DOUBLE (make PRECISION=double) for double */
+#if !defined(FTYPE_FLOAT) && !defined(FTYPE_DOUBLE)
+#define FTYPE_FLOAT
+#endif
+
+#if defined(FTYPE_DOUBLE)
 typedef double ftype;
+#define FTYPE_NAME "double"
 #define fpow pow
 #define ftan tan
 #define flog log10
@@ -23,6 +32,7 @@ typedef double ftype;
 #define ftmin -(DBL_MAX)
 #else
 typedef float ftype;
+#define FTYPE_NAME "float"
 #define fpow powf
 #define ftan tanf
 #define flog log10f
@@ -31,6 +41,8 @@ typedef float ftype;
 #define ftmin -(FLT_MAX)
 #endif
 
+#define CACHELINE 64 /* align data shared between threads to this to avoid false sharing */
+
 static const ftype min_level = fpow(10.0, -130.0/20.0); /* noise below this */
 
 #define to_pow_2(x) ({ \
@@ -59,6 +71,53 @@ static inline void clear_timer(struct timespec *ts){
 	ts->tv_sec=ts->tv_nsec=0;
 }
 
+/* sample clock timers- hold the frame count the timer expires at, 0 when not set.
+ * Used in the realtime thread, so no clock syscalls */
+static inline void set_ftimer(uint64_t *t, uint64_t now, uint64_t frames){
+	*t = now + frames ?: 1;
+}
+
+/* return 1 if not expired at frame now, return 0 if expired (and clear the timer), or if not started */
+static inline int ftimer_poll(uint64_t *t, uint64_t now){
+	if(!*t)
+		return 0; /* timer disabled */
+	if(now < *t)
+		return 1;
+	*t = 0;
+	return 0;
+}
+
+static inline uint64_t ms_to_frames(uint64_t ms, double samplerate){
+	return (uint64_t)(ms * samplerate / 1000.0);
+}
+
+/* ns from sample clock frame from to frame to, 0 if to is earlier */
+static inline uint64_t frames_to_ns(uint64_t from, uint64_t to, double samplerate){
+	return to > from ? (uint64_t)((to - from) * 1e9 / samplerate) : 0;
+}
+
+static inline uint64_t timespec_ns(const struct timespec *ts){
+	return ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/* log2 latency histogram- bucket 0 is under 2us, bucket i from 2^i us up to 2^(i+1) us, the last takes the rest */
+#define HIST_BUCKETS 24
+struct hist {
+	unsigned long n;
+	uint64_t sum_ns, max_ns;
+	unsigned long bucket[HIST_BUCKETS];
+};
+
+static inline void hist_add(struct hist * h, uint64_t ns){
+	uint64_t us = ns / 1000;
+	unsigned b = us < 2 ? 0 : 63 - __builtin_clzll(us);
+	h->bucket[b < HIST_BUCKETS ? b : HIST_BUCKETS - 1]++;
+	h->n++;
+	h->sum_ns += ns;
+	if(ns > h->max_ns)
+		h->max_ns = ns;
+}
+
 static inline void millisleep(int ms) {
 	struct timespec t;
 	t.tv_nsec = ms%1000 * 1000000L; /* restrict to sub-second magnitude to prevent overflow of nsec var */
@@ -81,27 +140,32 @@ static inline int timespec_compare(const struct timespec *lhs, const struct time
 }
 
 int timer_poll(struct timespec * ts);
+void hist_print(FILE * fp, const char * prefix, const char * name, const struct hist * h);
+void * aligned_calloc(size_t n, size_t size);
+
+/* sequence lock- single writer never blocks, readers retry if the writer was active.
+ * Sequence is odd while the writer is updating the protected data */
+static inline void seq_write_begin(atomic_uint * seq){
+	atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
 
-struct systemcall_env {
-	char * var;
-	char * val;
-};
+static inline void seq_write_end(atomic_uint * seq){
+	atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_release);
+}
 
-struct gpio_info {
-	int gpio;
-	bool initialised;
-	bool active_low;
-	bool val;
-	char * name;
-	char * direction_path;
-	char * value_path;
-	char * active_low_path;
-	char * pidfile;
-};
+static inline unsigned seq_read_begin(atomic_uint * seq){
+	unsigned s;
+	while((s = atomic_load_explicit(seq, memory_order_acquire)) & 1)
+		; /* writer is mid update- its realtime and short so just spin */
+	return s;
+}
 
-int systemcall(const char * command, const struct systemcall_env * env,  unsigned timeout_ms);
-int gpio_init(struct gpio_info * gpio);
-int gpio_set(struct gpio_info * gpio, bool value);
+/* return true if the data read since seq_read_begin() is inconsistent and needs to be read again */
+static inline bool seq_read_retry(atomic_uint * seq, unsigned s){
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(seq, memory_order_relaxed) != s;
+}
 
 int fifo_open(const char *path);
 void fifo_close(int fd);
@@ -0,0 +1,66 @@
+/*
+ * vu.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Binary VU stream, vu_format = float or cdb. Include this in a reader- it has no other dependencies.
+ * Each frame is one write, so a reader gets whole frames: a header, then rms and peak for each channel,
+ * then loudness if VU_FLAG_LOUD is set, then band levels if VU_FLAG_BANDS is set.
+ * Little endian, as the host.
+ */
+
+#ifndef VU_H_
+#define VU_H_
+
+#include <stdint.h>
+
+#define VU_FRAME_MAGIC 0x4d56434a /* "JCVM" */
+
+enum vu_format {
+	VU_FORMAT_TEXT = 0, /* "rms peak " dB pairs per channel, a line per update */
+	VU_FORMAT_FLOAT, /* struct vu_float per channel- linear 0..1 */
+	VU_FORMAT_CDB, /* struct vu_cdb per channel- dBFS * 100, INT16_MIN for silence */
+};
+
+/* flags */
+#define VU_FLAG_CLIP 0x01 /* a channel clipped since the last frame */
+#define VU_FLAG_TRIG 0x02 /* level trigger is on */
+#define VU_FLAG_LOUD 0x04 /* a struct vu_loud follows the channels */
+#define VU_FLAG_BANDS 0x08 /* a struct vu_bands and its levels follow that */
+
+struct vu_frame {
+	uint32_t magic;
+	uint32_t seq; /* increments every frame- a gap means frames were dropped */
+	uint64_t frame; /* sample clock of the frame */
+	uint32_t samplerate;
+	uint16_t channels;
+	uint8_t format; /* enum vu_format */
+	uint8_t flags;
+} __attribute__((packed));
+
+struct vu_float {
+	float rms;
+	float peak;
+} __attribute__((packed));
+
+struct vu_cdb {
+	int16_t rms;
+	int16_t peak;
+} __attribute__((packed));
+
+/* loudness = 1- for either format. -INFINITY until there is enough audio for the value */
+struct vu_loud {
+	float m; /* momentary, LUFS */
+	float s; /* short term, LUFS */
+	float i; /* integrated, LUFS */
+	float lra; /* loudness range, LU */
+} __attribute__((packed));
+
+/* bands = 10 or 31- then channels * bands levels, a channels bands lowest frequency first. float linear rms,
+ * or int16_t dBFS * 100 for VU_FORMAT_CDB. Channels may be fewer than the frames if they wouldn't all fit */
+struct vu_bands {
+	uint16_t bands;
+	uint16_t channels;
+} __attribute__((packed));
+
+#endif /* VU_H_ */
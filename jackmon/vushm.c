@@ -0,0 +1,92 @@
+/*
+ * vushm.c
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Writer side of the shared memory meter ring- see vushm.h.
+ * Opened by the main loop once channels are known, then published from the realtime thread with plain stores.
+ * When the channel bank is resized it is laid out again once the realtime thread is off the old one.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "audio.h"
+#include "vushm.h"
+
+/* create or reuse /dev/shm/vu_shm sized for our channels. Readers attached to an old layout see the epoch change.
+ * Called again after a resize- it only grows, so a reader mapped at the old size never faults */
+int vushm_open(struct audio * audio){
+	char path[256];
+	snprintf(path, sizeof(path), "%s%s", audio->vu_shm[0] == '/' ? "" : "/", audio->vu_shm);
+	unsigned channels = audio->channels < VUSHM_MAX_CHANNELS ? audio->channels : VUSHM_MAX_CHANNELS;
+	size_t slot_size = VUSHM_SLOT_SIZE(channels);
+	size_t size = VUSHM_HDR_SIZE + VUSHM_SLOTS * slot_size;
+
+	int fd = shm_open(path, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+	if(fd < 0){
+		fprintf(stderr, "Can't open shared memory %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	vushm_close(audio);
+	void * p = MAP_FAILED;
+	struct stat st;
+	if(!fstat(fd, &st) && (st.st_size >= (off_t)size || !ftruncate(fd, size)))
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED){
+		fprintf(stderr, "Can't map shared memory %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	/* invalidate for attached readers, then lay it out and touch every page so the realtime thread never faults */
+	struct vushm_hdr * h = p;
+	atomic_store_explicit(&h->magic, 0, memory_order_release);
+	unsigned epoch = atomic_load_explicit(&h->epoch, memory_order_relaxed) + 1;
+	atomic_store_explicit(&h->epoch, epoch, memory_order_release);
+	memset((char *)p + VUSHM_HDR_SIZE, 0, size - VUSHM_HDR_SIZE);
+	h->version = VUSHM_VERSION;
+	h->channels = channels;
+	h->samplerate = audio->samplerate;
+	h->slots = VUSHM_SLOTS;
+	h->slot_size = slot_size;
+	h->pid = getpid();
+	atomic_store_explicit(&h->head, 0, memory_order_relaxed);
+	atomic_store_explicit(&h->magic, VUSHM_MAGIC, memory_order_release);
+
+	audio->_shm_map = h;
+	audio->shm_size = size;
+	atomic_store_explicit(&audio->shm, h, memory_order_release);
+	debug(audio, "Meter ring in /dev/shm%s, %u channels, %u slots of %zu bytes\n", path, channels, VUSHM_SLOTS, slot_size);
+	return 0;
+}
+
+/* realtime thread- publish the channel snapshots of bank for the cycle ending at frame. No syscalls */
+void vushm_publish(struct vushm_hdr * h, const struct audio_bank * bank, uint64_t frame){
+	uint64_t n = atomic_load_explicit(&h->head, memory_order_relaxed);
+	struct vushm_slot * s = vushm_slot(h, n);
+	seq_write_begin(&s->seq);
+	s->n = n;
+	s->frame = frame;
+	s->channels = h->channels;
+	for(unsigned i = 0; i < h->channels; i++){
+		s->chan[i].rms = bank->snap[i].rms;
+		s->chan[i].peak = bank->snap[i].peak;
+		s->chan[i].clips = bank->snap[i].clips;
+	}
+	seq_write_end(&s->seq);
+	atomic_store_explicit(&h->head, n + 1, memory_order_release);
+}
+
+/* leave the object in /dev/shm so readers survive a restart- just unmap */
+void vushm_close(struct audio * audio){
+	atomic_store_explicit(&audio->shm, NULL, memory_order_relaxed);
+	if(audio->_shm_map)
+		munmap(audio->_shm_map, audio->shm_size);
+	audio->_shm_map = NULL;
+}
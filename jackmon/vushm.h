@@ -0,0 +1,174 @@
+/*
+ * vushm.h
+ *
+ *  Created on: 16 Oct 2026
+ *
+ * Shared memory meter ring, vu_shm = name- published in /dev/shm/name every process cycle.
+ * Include this in a reader- it has no other dependencies. Any number of readers attach read only,
+ * each at its own pace, and the realtime writer never waits on them.
+ *
+ *	struct vushm_reader r;
+ *	struct vushm_slot * s = malloc(VUSHM_SLOT_SIZE(VUSHM_MAX_CHANNELS));
+ *	vushm_attach(&r, "jackmon");
+ *	while(vushm_latest(&r, s, VUSHM_MAX_CHANNELS) >= 0) ... or vushm_next() for every slot in order
+ */
+
+#ifndef VUSHM_H_
+#define VUSHM_H_
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define VUSHM_MAGIC 0x4d53434a /* "JCSM" */
+#define VUSHM_VERSION 1
+#define VUSHM_SLOTS 64 /* ~340ms of 256 frame cycles at 48k */
+#define VUSHM_MAX_CHANNELS 256
+
+struct vushm_chan {
+	float rms; /* linear 0..1 */
+	float peak; /* held peak, linear 0..1 */
+	uint32_t clips; /* running count of clip events */
+};
+
+/* one process cycle. seq is odd while the writer is in it */
+struct vushm_slot {
+	atomic_uint seq;
+	uint32_t channels;
+	uint64_t n; /* slot number- head when it was written */
+	uint64_t frame; /* sample clock at the end of the cycle */
+	struct vushm_chan chan[];
+};
+
+#define VUSHM_SLOT_SIZE(channels) \
+	((sizeof(struct vushm_slot) + (channels) * sizeof(struct vushm_chan) + 63) & ~(size_t)63)
+
+struct vushm_hdr {
+	atomic_uint magic; /* set last by the writer once the rest is valid, 0 while it (re)initialises */
+	uint32_t version;
+	uint32_t channels;
+	uint32_t samplerate;
+	uint32_t slots;
+	uint32_t slot_size; /* bytes, slots follow the header at VUSHM_HDR_SIZE */
+	atomic_uint epoch; /* incremented each time the writer (re)initialises- reattach if it changes */
+	uint32_t pid; /* writer */
+	_Alignas(64) _Atomic uint64_t head; /* slots written- the latest is head - 1 */
+};
+
+#define VUSHM_HDR_SIZE ((sizeof(struct vushm_hdr) + 63) & ~(size_t)63)
+
+static inline struct vushm_slot * vushm_slot(const struct vushm_hdr * h, uint64_t n){
+	return (struct vushm_slot *)((char *)h + VUSHM_HDR_SIZE + (n % h->slots) * h->slot_size);
+}
+
+struct vushm_reader {
+	const struct vushm_hdr * h;
+	size_t size;
+	unsigned epoch;
+	uint64_t pos; /* next slot to read */
+	uint64_t lost; /* slots overwritten before vushm_next() got to them */
+};
+
+static inline void vushm_detach(struct vushm_reader * r){
+	if(r->h)
+		munmap((void *)r->h, r->size);
+	r->h = NULL;
+}
+
+/* map /dev/shm/name read only. return 0, or -1 with errno, EAGAIN if the writer hasn't initialised it yet */
+static inline int vushm_attach(struct vushm_reader * r, const char * name){
+	char path[256];
+	memset(r, 0, sizeof(*r));
+	if(name[0] != '/')
+		snprintf(path, sizeof(path), "/%s", name);
+	else
+		snprintf(path, sizeof(path), "%s", name);
+	int fd = shm_open(path, O_RDONLY, 0);
+	if(fd < 0)
+		return -1;
+	struct stat st;
+	void * p = MAP_FAILED;
+	if(!fstat(fd, &st) && st.st_size >= (off_t)VUSHM_HDR_SIZE)
+		p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED){
+		errno = EAGAIN;
+		return -1;
+	}
+	r->h = p;
+	r->size = st.st_size;
+	const struct vushm_hdr * h = r->h;
+	r->epoch = atomic_load_explicit((atomic_uint *)&h->epoch, memory_order_relaxed);
+	if(atomic_load_explicit((atomic_uint *)&h->magic, memory_order_acquire) != VUSHM_MAGIC ||
+			h->version != VUSHM_VERSION || VUSHM_HDR_SIZE + (size_t)h->slots * h->slot_size > r->size){
+		vushm_detach(r);
+		errno = EAGAIN;
+		return -1;
+	}
+	r->pos = atomic_load_explicit((_Atomic uint64_t *)&h->head, memory_order_acquire);
+	return 0;
+}
+
+/* copy slot n into s, with up to max channels. return 1 if copied, 0 if not written yet,
+ * -1 if its been overwritten, -2 if the writer reinitialised (reattach) */
+static inline int vushm_copy(struct vushm_reader * r, uint64_t n, struct vushm_slot * s, unsigned max){
+	const struct vushm_hdr * h = r->h;
+	struct vushm_slot * slot = vushm_slot(h, n);
+	unsigned seq;
+	do {
+		if(atomic_load_explicit((atomic_uint *)&h->magic, memory_order_acquire) != VUSHM_MAGIC ||
+				atomic_load_explicit((atomic_uint *)&h->epoch, memory_order_relaxed) != r->epoch)
+			return -2;
+		while((seq = atomic_load_explicit(&slot->seq, memory_order_acquire)) & 1)
+			; /* writer is mid update- its realtime and short so just spin */
+		s->n = slot->n;
+		s->frame = slot->frame;
+		s->channels = slot->channels < max ? slot->channels : max;
+		memcpy(s->chan, slot->chan, s->channels * sizeof(struct vushm_chan));
+		atomic_thread_fence(memory_order_acquire);
+	} while(atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq);
+	return s->n == n ? 1 : s->n < n ? 0 : -1;
+}
+
+/* read the next slot in order. return 1 with the slot, 0 if nothing new, -2 to reattach.
+ * If the reader fell more than a ring behind it skips to the oldest slot and counts the gap in lost */
+static inline int vushm_next(struct vushm_reader * r, struct vushm_slot * s, unsigned max){
+	while(true){
+		uint64_t head = atomic_load_explicit((_Atomic uint64_t *)&r->h->head, memory_order_acquire);
+		if(r->pos >= head)
+			return 0;
+		if(head - r->pos > r->h->slots - 1){ /* the oldest may be being overwritten */
+			r->lost += head - r->pos - (r->h->slots - 1);
+			r->pos = head - (r->h->slots - 1);
+		}
+		int ret = vushm_copy(r, r->pos, s, max);
+		if(ret == 1)
+			r->pos++;
+		if(ret != -1)
+			return ret;
+	}
+}
+
+/* read the most recent slot, eg for a display. return 1 with the slot, 0 if nothing new since last read, -2 to reattach */
+static inline int vushm_latest(struct vushm_reader * r, struct vushm_slot * s, unsigned max){
+	while(true){
+		uint64_t head = atomic_load_explicit((_Atomic uint64_t *)&r->h->head, memory_order_acquire);
+		if(r->pos >= head)
+			return 0;
+		int ret = vushm_copy(r, head - 1, s, max);
+		if(ret == 1)
+			r->pos = head;
+		if(ret != -1)
+			return ret;
+	}
+}
+
+#endif /* VUSHM_H_ */